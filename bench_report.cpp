@@ -0,0 +1,239 @@
+#include "bench_report.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+namespace htio2
+{
+template<>
+bool from_string<ReportFormat>(const std::string& input, ReportFormat& result)
+{
+    if (input == "json") result = REPORT_FORMAT_JSON;
+    else if (input == "csv") result = REPORT_FORMAT_CSV;
+    else return false;
+    return true;
+}
+
+template<>
+std::string to_string<ReportFormat>(ReportFormat input)
+{
+    switch (input)
+    {
+    case REPORT_FORMAT_JSON: return "json";
+    case REPORT_FORMAT_CSV: return "csv";
+    case REPORT_FORMAT_INVALID: return "invalid";
+    default: abort();
+    }
+}
+
+} // namespace htio2
+
+double now_us()
+{
+    typedef std::chrono::steady_clock clock_type;
+    return std::chrono::duration<double, std::micro>(clock_type::now().time_since_epoch()).count();
+}
+
+double LatencyRecorder::total() const
+{
+    double sum = 0.0;
+    for (size_t i = 0; i < samples.size(); i++)
+        sum += samples[i];
+    return sum;
+}
+
+static double nearest_rank(const std::vector<double>& sorted, double pct)
+{
+    size_t rank = size_t(std::ceil(pct / 100.0 * sorted.size()));
+    if (rank < 1) rank = 1;
+    if (rank > sorted.size()) rank = sorted.size();
+    return sorted[rank - 1];
+}
+
+LatencySummary LatencyRecorder::summarize() const
+{
+    LatencySummary re;
+    if (samples.empty()) return re;
+
+    std::vector<double> sorted(samples);
+    std::sort(sorted.begin(), sorted.end());
+
+    re.count = sorted.size();
+    re.min  = sorted.front();
+    re.max  = sorted.back();
+    re.mean = total() / sorted.size();
+    re.p50  = nearest_rank(sorted, 50.0);
+    re.p90  = nearest_rank(sorted, 90.0);
+    re.p99  = nearest_rank(sorted, 99.0);
+    re.p999 = nearest_rank(sorted, 99.9);
+    return re;
+}
+
+void BenchReport::set_attr(const std::string& key, const std::string& value)
+{
+    for (size_t i = 0; i < attrs.size(); i++)
+    {
+        if (attrs[i].first == key)
+        {
+            attrs[i].second = value;
+            return;
+        }
+    }
+    attrs.push_back(std::make_pair(key, value));
+}
+
+void BenchReport::add_phase(const std::string& name, const LatencySummary& summary)
+{
+    phases.push_back(std::make_pair(name, summary));
+}
+
+void BenchReport::add_metric(const std::string& name, double value)
+{
+    metrics.push_back(std::make_pair(name, value));
+}
+
+void print_report(const BenchReport& report)
+{
+    for (size_t i = 0; i < report.attrs.size(); i++)
+        printf("%s: %s\n", report.attrs[i].first.c_str(), report.attrs[i].second.c_str());
+
+    if (report.phases.size())
+    {
+        printf("%-24s %8s %12s %12s %12s %12s %12s %12s %12s\n",
+               "phase (us)", "count", "min", "mean", "p50", "p90", "p99", "p99.9", "max");
+        for (size_t i = 0; i < report.phases.size(); i++)
+        {
+            const LatencySummary& s = report.phases[i].second;
+            printf("%-24s %8lu %12.3f %12.3f %12.3f %12.3f %12.3f %12.3f %12.3f\n",
+                   report.phases[i].first.c_str(), (unsigned long) s.count,
+                   s.min, s.mean, s.p50, s.p90, s.p99, s.p999, s.max);
+        }
+    }
+
+    for (size_t i = 0; i < report.metrics.size(); i++)
+        printf("%-24s %g\n", report.metrics[i].first.c_str(), report.metrics[i].second);
+}
+
+static void write_json_string(FILE* fh, const std::string& value)
+{
+    fputc('"', fh);
+    for (size_t i = 0; i < value.size(); i++)
+    {
+        char c = value[i];
+        if (c == '"' || c == '\\') fprintf(fh, "\\%c", c);
+        else if ((unsigned char) c < 0x20) fprintf(fh, "\\u%04x", c);
+        else fputc(c, fh);
+    }
+    fputc('"', fh);
+}
+
+static void write_json(FILE* fh, const std::vector<BenchReport>& reports)
+{
+    fprintf(fh, "[\n");
+    for (size_t i_rep = 0; i_rep < reports.size(); i_rep++)
+    {
+        const BenchReport& rep = reports[i_rep];
+        fprintf(fh, "  {\n    \"attrs\": {");
+        for (size_t i = 0; i < rep.attrs.size(); i++)
+        {
+            fprintf(fh, i ? ", " : "");
+            write_json_string(fh, rep.attrs[i].first);
+            fprintf(fh, ": ");
+            write_json_string(fh, rep.attrs[i].second);
+        }
+
+        fprintf(fh, "},\n    \"phases\": {");
+        for (size_t i = 0; i < rep.phases.size(); i++)
+        {
+            const LatencySummary& s = rep.phases[i].second;
+            fprintf(fh, i ? ",\n      " : "\n      ");
+            write_json_string(fh, rep.phases[i].first);
+            fprintf(fh, ": {\"count\": %lu, \"min\": %.17g, \"mean\": %.17g, \"p50\": %.17g, \"p90\": %.17g, "
+                        "\"p99\": %.17g, \"p99.9\": %.17g, \"max\": %.17g}",
+                    (unsigned long) s.count, s.min, s.mean, s.p50, s.p90, s.p99, s.p999, s.max);
+        }
+
+        fprintf(fh, "\n    },\n    \"metrics\": {");
+        for (size_t i = 0; i < rep.metrics.size(); i++)
+        {
+            fprintf(fh, i ? ", " : "");
+            write_json_string(fh, rep.metrics[i].first);
+            fprintf(fh, ": %.17g", rep.metrics[i].second);
+        }
+        fprintf(fh, "}\n  }%s\n", (i_rep + 1 < reports.size()) ? "," : "");
+    }
+    fprintf(fh, "]\n");
+}
+
+static void write_csv_attrs(FILE* fh, const BenchReport& rep, const BenchReport& header)
+{
+    for (size_t i = 0; i < header.attrs.size(); i++)
+    {
+        const std::string& key = header.attrs[i].first;
+        for (size_t j = 0; j < rep.attrs.size(); j++)
+        {
+            if (rep.attrs[j].first == key)
+            {
+                fprintf(fh, "%s", rep.attrs[j].second.c_str());
+                break;
+            }
+        }
+        fputc(',', fh);
+    }
+}
+
+static void write_csv(FILE* fh, const std::vector<BenchReport>& reports)
+{
+    if (reports.empty()) return;
+    const BenchReport& header = reports[0];
+
+    for (size_t i = 0; i < header.attrs.size(); i++)
+        fprintf(fh, "%s,", header.attrs[i].first.c_str());
+    fprintf(fh, "kind,name,count,min,mean,p50,p90,p99,p99.9,max,value\n");
+
+    for (size_t i_rep = 0; i_rep < reports.size(); i_rep++)
+    {
+        const BenchReport& rep = reports[i_rep];
+        for (size_t i = 0; i < rep.phases.size(); i++)
+        {
+            const LatencySummary& s = rep.phases[i].second;
+            write_csv_attrs(fh, rep, header);
+            fprintf(fh, "phase,%s,%lu,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,\n",
+                    rep.phases[i].first.c_str(), (unsigned long) s.count,
+                    s.min, s.mean, s.p50, s.p90, s.p99, s.p999, s.max);
+        }
+        for (size_t i = 0; i < rep.metrics.size(); i++)
+        {
+            write_csv_attrs(fh, rep, header);
+            fprintf(fh, "metric,%s,,,,,,,,,%.9g\n", rep.metrics[i].first.c_str(), rep.metrics[i].second);
+        }
+    }
+}
+
+bool write_reports(const std::string& file, ReportFormat format, const std::vector<BenchReport>& reports)
+{
+    FILE* fh = (file == "-") ? stdout : fopen(file.c_str(), "wb");
+    if (!fh)
+    {
+        fprintf(stderr, "failed to open result file %s\n", file.c_str());
+        return false;
+    }
+
+    switch (format)
+    {
+    case REPORT_FORMAT_JSON:
+        write_json(fh, reports);
+        break;
+    case REPORT_FORMAT_CSV:
+        write_csv(fh, reports);
+        break;
+    default:
+        abort();
+    }
+
+    if (fh != stdout) fclose(fh);
+    return true;
+}
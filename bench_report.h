@@ -0,0 +1,90 @@
+#ifndef MY_BENCH_REPORT_H
+#define MY_BENCH_REPORT_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "htio2/Cast.h"
+
+typedef enum {
+    REPORT_FORMAT_JSON = 0,
+    REPORT_FORMAT_CSV = 1,
+    REPORT_FORMAT_INVALID = 255,
+} ReportFormat;
+
+namespace htio2
+{
+template<>
+bool from_string<ReportFormat>(const std::string& input, ReportFormat& result);
+
+template<>
+std::string to_string<ReportFormat>(ReportFormat input);
+
+} // namespace htio2
+
+///
+/// \brief current time of a monotonic high-resolution clock, in microseconds
+///
+double now_us();
+
+struct LatencySummary
+{
+    size_t count = 0;
+    double min  = 0.0;
+    double mean = 0.0;
+    double p50  = 0.0;
+    double p90  = 0.0;
+    double p99  = 0.0;
+    double p999 = 0.0;
+    double max  = 0.0;
+};
+
+///
+/// \brief collects per-iteration latency samples of one phase
+///
+class LatencyRecorder
+{
+public:
+    void reserve(size_t n) { samples.reserve(n); }
+    void add(double value) { samples.push_back(value); }
+    void clear() { samples.clear(); }
+    size_t size() const { return samples.size(); }
+    double total() const;
+
+    ///
+    /// \brief percentiles use the nearest-rank method over all recorded samples
+    ///
+    LatencySummary summarize() const;
+
+protected:
+    std::vector<double> samples;
+};
+
+///
+/// \brief one result record: identifying attributes, latency of each phase and
+/// scalar metrics
+///
+struct BenchReport
+{
+    void set_attr(const std::string& key, const std::string& value);
+    void add_phase(const std::string& name, const LatencySummary& summary);
+    void add_metric(const std::string& name, double value);
+
+    std::vector<std::pair<std::string, std::string> >    attrs;
+    std::vector<std::pair<std::string, LatencySummary> > phases;
+    std::vector<std::pair<std::string, double> >         metrics;
+};
+
+void print_report(const BenchReport& report);
+
+///
+/// \brief write reports to file, or to stdout if file is "-"
+///
+/// CSV output is tidy: one row per phase or metric, prefixed by the attributes
+/// of the report it belongs to. Attribute columns are taken from the first
+/// report.
+///
+bool write_reports(const std::string& file, ReportFormat format, const std::vector<BenchReport>& reports);
+
+#endif // MY_BENCH_REPORT_H
@@ -1,75 +1,120 @@
 #include "utils.h"
+#include "bench_report.h"
+#include "cl_profile.h"
+#include "host_math.h"
+#include "kernel_source.h"
+#include "tune_cache.h"
+#include "program_cache.h"
+#include "expr.h"
+#include "validator.h"
+#include "command_buffer.h"
+#include "buffer_pool.h"
+#include "half_convert.h"
+#include "storage_traits.h"
+#include "input_gen.h"
+#include "completion_queue.h"
+#include "perf_counters.h"
+#include "numa_host.h"
+#include "thread_pool.h"
 
 #include "htio2/OptionParser.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cstdio>
 #include <cmath>
 #include <cstdlib>
 #include <cstring>
-
-const char* src_sin =
-        "__kernel void hello(__global float* in,\n"
-        "                    __global float* out,\n"
-        "                    int num_sample,\n"
-        "                    int chunk_size)\n"
-        "{\n"
-        "    int tid = get_global_id(0);\n"
-        "    for (int i = 0; i < chunk_size; i++)\n"
-        "    {\n"
-        "       int idx = tid * chunk_size + i;\n"
-        "       if (idx >= num_sample) break;\n"
-        "       float tmp = in[idx];\n"
-        "       out[idx] = sin(tmp) + sin(2 * tmp) + sin(tmp * tmp) + sin(tmp + 0.5);\n"
-        "    }\n"
-        "}\n";
-
-const char* src_tan =
-        "__kernel void hello(__global float* in,\n"
-        "                    __global float* out,\n"
-        "                    int num_sample,\n"
-        "                    int chunk_size)\n"
-        "{\n"
-        "    int tid = get_global_id(0);\n"
-        "    for (int i = 0; i < chunk_size; i++)\n"
-        "    {\n"
-        "       int idx = tid * chunk_size + i;\n"
-        "       if (idx >= num_sample) break;\n"
-        "       float tmp = in[idx];\n"
-        "       out[idx] = tan(tmp) + tan(2 * tmp) + tan(tmp * tmp) + tan(tmp + 0.5);\n"
-        "    }\n"
-        "}\n";
-
-const char* src_mix =
-        "__kernel void hello(__global float* in,\n"
-        "                    __global float* out,\n"
-        "                    int num_sample,\n"
-        "                    int chunk_size)\n"
-        "{\n"
-        "    int tid = get_global_id(0);\n"
-        "    for (int i = 0; i < chunk_size; i++)\n"
-        "    {\n"
-        "       int idx = tid * chunk_size + i;\n"
-        "       if (idx >= num_sample) break;\n"
-        "       float tmp = in[idx];\n"
-        "       out[idx] = tan(tmp) + tan(2 * tmp) + sin(tmp * tmp) + cos(tmp + 0.5);\n"
-        "    }\n"
-        "}\n";
+#include <limits>
+#include <thread>
+#include <vector>
 
 BufferMode mode = BUFFER_MODE_INVALID;
 JobType job = JOB_TYPE_MIXED;
-int num_sample = 1024;
+std::string formula_text;
+Expr formula;
+KernelLayout kernel_layout = KERNEL_LAYOUT_CHUNKED;
+int local_size_opt = 0;
+bool do_autotune;
+bool do_retune;
+std::string tune_cache_file = "cltoy_tune.txt";
+std::string binary_cache_dir;
+int64_t num_sample = 1024;
 int num_iter = 1;
+int pipeline_depth = 0;
+int async_depth = 0;
+int64_t stream_tile = 0;
+int stream_depth = 3;
+std::string sweep_spec;
+int64_t sweep_min = 0;
+int64_t sweep_max = 0;
+int64_t sweep_factor = 2;
+int host_threads = 0;
+int host_chunk = 4096;
+bool pin_threads;
+NumaPolicy numa_policy = NUMA_POLICY_NONE;
+int numa_node_opt = -1;
+bool host_scaling;
+bool multi_device;
+bool co_exec;
+bool fused;
+bool replay;
+int batch_size = 0;
+bool out_of_order;
+bool no_buffer_pool;
+std::vector<StorageType> compare_storage;
+InputDist input_dist = INPUT_DIST_RAMP;
+InputSource input_source = INPUT_SOURCE_HOST;
+int64_t input_seed = 1;
 bool help;
 bool do_validate;
+int64_t validate_sample = 0;
+bool do_profile;
+bool do_perf;
+std::string result_file;
+ReportFormat result_format = REPORT_FORMAT_JSON;
 
 htio2::Option opt_mode("buffer-mode", 'm', "General Parameters",
                        &mode, 0,
-                       "dummy | hostmap | devicemap | pinned", "MODE");
+                       "dummy | hostmap | devicemap | pinned | zerocopy", "MODE");
 
 htio2::Option opt_job("job", 'j', "Job Type",
                       &job, 0,
                       "mixed | sine | tangent", "JOB");
 
+htio2::Option opt_formula("formula", 'F', "Job Type",
+                          &formula_text, 0,
+                          "Calculate this formula over input sample x instead of the job type, "
+                          "e.g. \"tan(x)+tan(2*x)+sin(x*x)+cos(x+0.5)\". "
+                          "Supports + - * /, sin cos tan sqrt exp log.", "EXPR");
+
+htio2::Option opt_kernel_layout("kernel-layout", 'L', "Job Type",
+                                &kernel_layout, 0,
+                                "chunked | interleaved | vec4 | vec8 | single", "LAYOUT");
+
+htio2::Option opt_local_size("local-size", 'l', "Job Type",
+                             &local_size_opt, 0,
+                             "Work-group size, 0 to let the runtime choose. "
+                             "The single layout defaults to the kernel's preferred multiple.", "INT");
+
+htio2::Option opt_autotune("autotune", 'A', "Job Type",
+                           &do_autotune, 0,
+                           "Use the tuned global and local size from the tuning cache, "
+                           "or sweep them and store the fastest when the cache has none.");
+
+htio2::Option opt_retune("retune", 0, "Job Type",
+                         &do_retune, 0,
+                         "With --autotune, sweep again even if the tuning cache has a result.");
+
+htio2::Option opt_tune_cache("tune-cache", 0, "Job Type",
+                             &tune_cache_file, 0,
+                             "Tuning cache file.", "FILE");
+
+htio2::Option opt_binary_cache("binary-cache", 0, "Job Type",
+                               &binary_cache_dir, 0,
+                               "Directory to save built program binaries in and load them from, "
+                               "skipping the compiler on later runs.", "DIR");
+
 htio2::Option opt_num_sample("num-sample", 'n', "General Parameters",
                              &num_sample, 0,
                              "Number of samples to calculate.", "INT");
@@ -78,10 +123,145 @@ htio2::Option opt_num_iter("num-iter", 'i', "General Parameters",
                            &num_iter, 0,
                            "Number of times to run.", "INT");
 
+htio2::Option opt_pipeline_depth("pipeline-depth", 'd', "General Parameters",
+                                 &pipeline_depth, 0,
+                                 "After the serial run, run again with this many in-flight iterations that overlap "
+                                 "upload, kernel and download. Requires pinned mode. 0 to disable.", "INT");
+
+htio2::Option opt_async_depth("async", 0, "General Parameters",
+                              &async_depth, 0,
+                              "After the serial run, run again as this many independent requests in flight, "
+                              "enqueued without blocking and completed through event callbacks. "
+                              "Requires pinned mode. 0 to disable.", "INT");
+
+htio2::Option opt_replay("replay", 0, "General Parameters",
+                         &replay, 0,
+                         "After the serial run, run again replaying commands recorded once, through "
+                         "cl_khr_command_buffer when supported. Requires pinned mode.");
+
+htio2::Option opt_batch_size("batch", 'b', "General Parameters",
+                             &batch_size, 0,
+                             "After the serial run, run again enqueueing this many iterations back to back, and "
+                             "only wait at the end of each batch. Requires pinned mode. 0 to disable.", "INT");
+
+htio2::Option opt_out_of_order("out-of-order", 0, "General Parameters",
+                               &out_of_order, 0,
+                               "Run batches on an out-of-order queue, with two buffer sets ordered by events.");
+
+htio2::Option opt_no_buffer_pool("no-buffer-pool", 0, "General Parameters",
+                                 &no_buffer_pool, 0,
+                                 "Create and release device buffers for every run instead of reusing them "
+                                 "from the buffer pool, to measure the allocation cost.");
+
+htio2::Option opt_storage("storage", 0, "General Parameters",
+                          &compare_storage, 0, htio2::ValueLimit::Ranged(1, 3),
+                          "After the serial run, run again with device buffers of each of these element types. "
+                          "fp16 halves the bytes crossing the bus, the host converts with F16C when available. "
+                          "fp64 calculates in double and needs cl_khr_fp64. "
+                          "Requires hostmap, devicemap or pinned mode.", "fp16 | fp64 ...");
+
+htio2::Option opt_input_dist("input-dist", 0, "Job Type",
+                             &input_dist, 0,
+                             "Input samples: ramp is the sample index, uniform and normal are drawn from a "
+                             "counter-based generator, identical on host and device.", "ramp | uniform | normal");
+
+htio2::Option opt_input_source("input-source", 0, "Job Type",
+                               &input_source, 0,
+                               "Where the kernel gets input from: host uploads it every iteration, device "
+                               "generates it in the kernel, resident uploads it once and reuses the device buffer. "
+                               "device and resident only apply to the serial run.", "host | device | resident");
+
+htio2::Option opt_input_seed("input-seed", 0, "Job Type",
+                             &input_seed, 0,
+                             "Seed of the uniform and normal inputs.", "INT");
+
+htio2::Option opt_stream_tile("stream-tile", 's', "General Parameters",
+                              &stream_tile, 0,
+                              "Instead of whole-job buffers, stream samples through a ring of device buffers of "
+                              "this many samples each, so device memory stays bounded for any sample number. "
+                              "Requires pinned mode. 0 to disable.", "INT");
+
+htio2::Option opt_stream_depth("stream-depth", 0, "General Parameters",
+                               &stream_depth, 0,
+                               "Number of tiles in the streaming ring, which are in flight at the same time.", "INT");
+
+htio2::Option opt_sweep("sweep", 0, "General Parameters",
+                         &sweep_spec, 0,
+                         "Instead of one run, sweep sample numbers MIN, MIN*FACTOR ... up to MAX over every "
+                         "buffer mode and job type, with one context and program. FACTOR defaults to 2.",
+                         "MIN:MAX[:FACTOR]");
+
+htio2::Option opt_host_threads("host-threads", 't', "Host Parameters",
+                               &host_threads, 0,
+                               "Number of host threads for dummy mode, 0 for all hardware threads.", "INT");
+
+htio2::Option opt_host_chunk("host-chunk", 0, "Host Parameters",
+                             &host_chunk, 0,
+                             "Samples per work-stealing chunk in dummy mode. "
+                             "The default keeps input and result of a chunk within L1 cache.", "INT");
+
+htio2::Option opt_pin_threads("pin-threads", 0, "Host Parameters",
+                              &pin_threads, 0,
+                              "Bind host thread i to CPU i.");
+
+htio2::Option opt_numa_policy("numa", 0, "Host Parameters",
+                              &numa_policy, 0,
+                              "none | firsttouch | mbind. Place the host arrays on one NUMA node, by touching them "
+                              "first from it or binding them with mbind, pin the driving thread to that node, and "
+                              "report memcpy bandwidth between the CPUs and memory of every pair of nodes.", "POLICY");
+
+htio2::Option opt_numa_node("numa-node", 0, "Host Parameters",
+                            &numa_node_opt, 0,
+                            "NUMA node of --numa. -1 for the node of the device's PCIe root when sysfs tells it, "
+                            "otherwise node 0.", "INT");
+
+htio2::Option opt_host_scaling("host-scaling", 0, "Host Parameters",
+                               &host_scaling, 0,
+                               "In dummy mode, also report throughput with 1, 2, 4 ... up to the "
+                               "configured number of host threads.");
+
+htio2::Option opt_multi_device("multi-device", 'M', "General Parameters",
+                               &multi_device, 0,
+                               "After the serial run, split the samples over every OpenCL device of every platform, "
+                               "in proportion to each device's measured throughput.");
+
+htio2::Option opt_co_exec("co-exec", 0, "Host Parameters",
+                          &co_exec, 0,
+                          "After the serial run, run again with host threads and the device pulling chunks "
+                          "from one shared sample counter. Requires a device buffer mode.");
+
+htio2::Option opt_fused("fused", 0, "General Parameters",
+                        &fused, 0,
+                        "After the serial run, calculate the mixed, sine and tangent jobs from one read of the input "
+                        "with their shared subexpressions calculated once, against running them one by one. "
+                        "Requires pinned mode.");
+
 htio2::Option opt_validate("validate", 'V', "General Parameters",
                            &do_validate, 0,
                            "Validate calculated results, which would cost extra time.");
 
+htio2::Option opt_validate_sample("validate-sample", 0, "General Parameters",
+                                  &validate_sample, 0,
+                                  "With --validate, check this many random samples of each result instead of all. "
+                                  "0 to check all.", "INT");
+
+htio2::Option opt_profile("profile", 'P', "General Parameters",
+                          &do_profile, 0,
+                          "Enable OpenCL event profiling, and report queued/submit/start/end gaps of each command.");
+
+htio2::Option opt_perf("perf", 0, "General Parameters",
+                       &do_perf, 0,
+                       "Count cycles, instructions, LLC misses, dTLB misses and page faults of the host threads "
+                       "in each phase of the serial run, through Linux perf_event_open.");
+
+htio2::Option opt_result_file("output", 'o', "Output",
+                              &result_file, 0,
+                              "Write timing results to this file, \"-\" for stdout.", "FILE");
+
+htio2::Option opt_result_format("output-format", 'f', "Output",
+                                &result_format, 0,
+                                "json | csv", "FORMAT");
+
 htio2::Option opt_help("help", 'h', "General Parameters",
                        &help, 0,
                        "Show help and exit.");
@@ -89,11 +269,34 @@ htio2::Option opt_help("help", 'h', "General Parameters",
 float* data_input = nullptr;
 float* data_result = nullptr;
 
+// element type of the main device buffers, host arrays are always float
+StorageType storage = STORAGE_FP32;
+
 void* pinned_input = nullptr;
 void* pinned_result = nullptr;
 
+// resident input is in the device buffer since the first upload
+bool input_uploaded = false;
+
+// zero-copy mode keeps the result buffer mapped between fetch_result() and
+// the next kernel, so the host may read and clear data_result in between
+bool zero_copy_result_mapped = false;
+
 size_t dim1_size = 0;
 
+// launch configuration of the kernel
+size_t global_size = 0;
+size_t local_size = 0;
+
+// where the launch configuration came from: default, cache or tuned
+std::string launch_source = "default";
+std::string kernel_src;
+
+// startup cost, in microseconds
+double time_program = 0.0;
+double time_startup = 0.0;
+std::string program_cache_state = "off";
+
 cl_platform_id plat = nullptr;
 cl_device_id dev    = nullptr;
 cl_context context  = nullptr;
@@ -107,6 +310,54 @@ cl_mem buf_input_dev   = nullptr;
 cl_mem buf_result_host = nullptr;
 cl_mem buf_result_dev  = nullptr;
 
+// device buffers of the context, except zero-copy ones wrapping host arrays
+BufferPool* buffer_pool = nullptr;
+
+// per-iteration wall time of each phase, in microseconds
+LatencyRecorder time_send;
+LatencyRecorder time_run;
+LatencyRecorder time_fetch;
+LatencyRecorder time_validate;
+LatencyRecorder time_iter;
+LatencyRecorder time_convert; // storage other than fp32 only, part of send and fetch
+
+std::vector<BenchReport> reports;
+
+HostThreadPool* host_pool = nullptr;
+
+// validation error since the last report, and the threads calculating it
+// when there is no host pool
+ErrorStats validate_stats;
+HostThreadPool* validate_pool = nullptr;
+uint64_t validate_seed = 0;
+
+EventProfiler profiler;
+
+// event slot for an enqueue, or nullptr when profiling is off
+cl_event* profile_event(cl_event* event)
+{
+    *event = nullptr;
+    return do_profile ? event : nullptr;
+}
+
+void profile_record(const char* command, cl_event event)
+{
+    if (do_profile) profiler.record(command, event);
+}
+
+// host counters of the serial run's phases, or nullptr when --perf is off
+PerfCounters* perf_counters = nullptr;
+
+void perf_mark(PerfCounters::Values& mark)
+{
+    if (perf_counters) mark = perf_counters->read();
+}
+
+void perf_lap(const char* phase, double bytes, PerfCounters::Values& mark)
+{
+    if (perf_counters) perf_counters->lap(phase, bytes, mark);
+}
+
 int str_to_int(const char* input)
 {
     char* end = const_cast<char*>(input);
@@ -124,9 +375,43 @@ void parse_arg(int argc, char** argv)
     htio2::OptionParser parser;
     parser.add_option(opt_mode);
     parser.add_option(opt_job);
+    parser.add_option(opt_formula);
+    parser.add_option(opt_kernel_layout);
+    parser.add_option(opt_local_size);
+    parser.add_option(opt_autotune);
+    parser.add_option(opt_retune);
+    parser.add_option(opt_tune_cache);
+    parser.add_option(opt_binary_cache);
     parser.add_option(opt_num_sample);
     parser.add_option(opt_num_iter);
+    parser.add_option(opt_pipeline_depth);
+    parser.add_option(opt_async_depth);
+    parser.add_option(opt_replay);
+    parser.add_option(opt_batch_size);
+    parser.add_option(opt_out_of_order);
+    parser.add_option(opt_no_buffer_pool);
+    parser.add_option(opt_storage);
+    parser.add_option(opt_input_dist);
+    parser.add_option(opt_input_source);
+    parser.add_option(opt_input_seed);
+    parser.add_option(opt_stream_tile);
+    parser.add_option(opt_stream_depth);
+    parser.add_option(opt_sweep);
+    parser.add_option(opt_host_threads);
+    parser.add_option(opt_host_chunk);
+    parser.add_option(opt_pin_threads);
+    parser.add_option(opt_numa_policy);
+    parser.add_option(opt_numa_node);
+    parser.add_option(opt_host_scaling);
+    parser.add_option(opt_multi_device);
+    parser.add_option(opt_co_exec);
+    parser.add_option(opt_fused);
     parser.add_option(opt_validate);
+    parser.add_option(opt_validate_sample);
+    parser.add_option(opt_profile);
+    parser.add_option(opt_perf);
+    parser.add_option(opt_result_file);
+    parser.add_option(opt_result_format);
     parser.add_option(opt_help);
 
     if (argc == 1)
@@ -145,7 +430,7 @@ void parse_arg(int argc, char** argv)
 
     if (num_sample <= 0)
     {
-        fprintf(stderr, "invalid sample number: %d, must > 0\n", num_sample);
+        fprintf(stderr, "invalid sample number: %lld, must > 0\n", (long long) num_sample);
         exit(1);
     }
 
@@ -155,6 +440,38 @@ void parse_arg(int argc, char** argv)
         exit(1);
     }
 
+    if (sweep_spec.length())
+    {
+        long long spec_min = 0;
+        long long spec_max = 0;
+        long long spec_factor = 2;
+        int num_field = sscanf(sweep_spec.c_str(), "%lld:%lld:%lld", &spec_min, &spec_max, &spec_factor);
+        if (num_field < 2 || spec_min <= 0 || spec_max < spec_min || spec_factor < 2)
+        {
+            fprintf(stderr, "invalid sweep \"%s\", must be MIN:MAX[:FACTOR] with 0 < MIN <= MAX and FACTOR >= 2\n",
+                    sweep_spec.c_str());
+            exit(1);
+        }
+        sweep_min = spec_min;
+        sweep_max = spec_max;
+        sweep_factor = spec_factor;
+
+        if (formula_text.length() || do_autotune || do_profile || pipeline_depth || async_depth || replay || batch_size ||
+            stream_tile || co_exec || fused || multi_device || host_scaling || compare_storage.size() ||
+            input_source != INPUT_SOURCE_HOST)
+        {
+            fprintf(stderr, "sweep covers buffer modes and job types by itself, and can not be combined with "
+                            "formula, autotune, profiling, pipelined, async, replay, batched, streaming, co-execution, "
+                            "fused, multi-device, host scaling, storage or device input runs.\n");
+            exit(1);
+        }
+
+        // host arrays are allocated once for the largest point; mode and job
+        // only matter for startup, the sweep goes through all of them
+        num_sample = sweep_max;
+        mode = BUFFER_MODE_DEVICE_MAP;
+    }
+
     if (mode == BUFFER_MODE_INVALID)
     {
         fprintf(stderr, "buffer mode is invalid or not specified.\n");
@@ -166,453 +483,3066 @@ void parse_arg(int argc, char** argv)
         fprintf(stderr, "job type is invalid or not specified.\n");
         exit(1);
     }
-}
-
-void create_context()
-{
-    if (mode == BUFFER_MODE_DUMMY) return;
 
-    cl_context_properties context_props[] = {
-        CL_CONTEXT_PLATFORM, cl_context_properties(plat),
-        0, 0
-    };
-    cl_int err = 0;
-    context = clCreateContext(context_props, 1, &dev, nullptr, nullptr, &err);
-    if (err != CL_SUCCESS)
+    if (validate_sample < 0)
     {
-        std::fprintf(stderr, "failed to create context: %d\n", err);
-        std::exit(1);
+        fprintf(stderr, "invalid validate sample number: %lld, must >= 0\n", (long long) validate_sample);
+        exit(1);
     }
-}
-
-void create_buffer_object()
-{
-    if (mode == BUFFER_MODE_DUMMY) return;
-
-    cl_int err = 0;
-    printf("create buffers in context %p\n", context);
 
-    if (mode == BUFFER_MODE_HOST_MAP)
+    if (host_threads < 0)
     {
-        // buffers are created at host side, and are mapped when need to be used
-        err = 0;
-        buf_input_host = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR, num_sample * sizeof(float), nullptr, &err);
-        if (err != CL_SUCCESS)
-        {
-            std::fprintf(stderr, "failed to create host-side input buffer: %d\n", err);
-            std::exit(1);
-        }
+        fprintf(stderr, "invalid host thread number: %d, must >= 0\n", host_threads);
+        exit(1);
+    }
 
-        err = 0;
-        buf_result_host = clCreateBuffer(context, CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR, num_sample * sizeof(float), nullptr, &err);
-        if (err != CL_SUCCESS)
-        {
-            std::fprintf(stderr, "failed to create host-side result buffer: %d\n", err);
-            std::exit(1);
-        }
+    if (host_chunk <= 0)
+    {
+        fprintf(stderr, "invalid host chunk size: %d, must > 0\n", host_chunk);
+        exit(1);
     }
-    else if (mode == BUFFER_MODE_DEVICE_MAP)
+
+    if (numa_policy == NUMA_POLICY_INVALID)
     {
-        // buffers are created at device side, and are mapped when need to be used
-        err = 0;
-        buf_input_dev = clCreateBuffer(context, CL_MEM_READ_ONLY, num_sample * sizeof(float), nullptr, &err);
-        if (err != CL_SUCCESS)
-        {
-            std::fprintf(stderr, "failed to create device-side input buffer: %d\n", err);
-            std::exit(1);
-        }
+        fprintf(stderr, "NUMA policy is invalid.\n");
+        exit(1);
+    }
 
-        err = 0;
-        buf_result_dev = clCreateBuffer(context, CL_MEM_WRITE_ONLY, num_sample * sizeof(float), nullptr, &err);
-        if (err != CL_SUCCESS)
-        {
-            std::fprintf(stderr, "failed to create device-side result buffer: %d\n", err);
-            std::exit(1);
-        }
+    if (numa_node_opt < -1)
+    {
+        fprintf(stderr, "invalid NUMA node: %d, must >= -1\n", numa_node_opt);
+        exit(1);
     }
-    else if (mode == BUFFER_MODE_PINNED)
+
+    if (host_scaling && mode != BUFFER_MODE_DUMMY)
     {
-        // According to Nvidia's best practice guide
-        // Buffers are created at both host and device side, and are mapped now.
-        // When transferring data, data referred by host-side pointer is read/write to device side buffer.
+        fprintf(stderr, "host scaling requires dummy mode.\n");
+        exit(1);
+    }
 
-        // input buffers
-        err = 0;
-        buf_input_host = clCreateBuffer(context, CL_MEM_ALLOC_HOST_PTR, num_sample * sizeof(float), nullptr, &err);
-        if (err != CL_SUCCESS)
-        {
-            std::fprintf(stderr, "failed to create host-side input buffer: %d\n", err);
-            std::exit(1);
-        }
+    if (co_exec && mode == BUFFER_MODE_DUMMY)
+    {
+        fprintf(stderr, "co-execution requires a device buffer mode.\n");
+        exit(1);
+    }
 
-        err = 0;
-        buf_input_dev = clCreateBuffer(context, CL_MEM_READ_ONLY, num_sample * sizeof(float), nullptr, &err);
-        if (err != CL_SUCCESS)
-        {
-            std::fprintf(stderr, "failed to create device-side input buffer: %d\n", err);
-            std::exit(1);
-        }
+    if (pipeline_depth < 0 || pipeline_depth == 1)
+    {
+        fprintf(stderr, "invalid pipeline depth: %d, must be 0 or > 1\n", pipeline_depth);
+        exit(1);
+    }
 
-        pinned_input = clEnqueueMapBuffer(cmd_queue, buf_input_host, true, CL_MAP_WRITE,
-                                          0, sizeof(float) * num_sample,
-                                          0, nullptr, nullptr,
-                                          &err);
-        if (err != CL_SUCCESS)
-        {
-            std::fprintf(stderr, "failed to map host-side input buffer: %d\n", err);
-            std::exit(1);
-        }
+    if (pipeline_depth > 1 && mode != BUFFER_MODE_PINNED)
+    {
+        fprintf(stderr, "pipelined run requires pinned mode.\n");
+        exit(1);
+    }
 
-        // result buffers
-        err = 0;
-        buf_result_host = clCreateBuffer(context, CL_MEM_ALLOC_HOST_PTR, num_sample * sizeof(float), nullptr, &err);
-        if (err != CL_SUCCESS)
-        {
-            std::fprintf(stderr, "failed to create host-side result buffer: %d\n", err);
-            std::exit(1);
-        }
+    if (async_depth < 0)
+    {
+        fprintf(stderr, "invalid async depth: %d, must >= 0\n", async_depth);
+        exit(1);
+    }
 
-        err = 0;
-        buf_result_dev = clCreateBuffer(context, CL_MEM_WRITE_ONLY, num_sample * sizeof(float), nullptr, &err);
-        if (err != CL_SUCCESS)
-        {
-            std::fprintf(stderr, "failed to create device-side buffer: %d\n", err);
-            std::exit(1);
-        }
+    if (async_depth && mode != BUFFER_MODE_PINNED)
+    {
+        fprintf(stderr, "async run requires pinned mode.\n");
+        exit(1);
+    }
 
-        pinned_result = clEnqueueMapBuffer(cmd_queue, buf_result_host, true, CL_MAP_READ,
-                                           0, sizeof(float) * num_sample,
-                                           0, nullptr, nullptr,
-                                           &err);
-        if (err != CL_SUCCESS)
-        {
-            std::fprintf(stderr, "failed to map host-side input buffer: %d\n", err);
-            std::exit(1);
-        }
+    if (batch_size < 0)
+    {
+        fprintf(stderr, "invalid batch size: %d, must >= 0\n", batch_size);
+        exit(1);
     }
-}
 
-char build_log[8192];
-void create_program_kernel()
-{
-    if (mode == BUFFER_MODE_DUMMY) return;
+    if (batch_size && mode != BUFFER_MODE_PINNED)
+    {
+        fprintf(stderr, "batched run requires pinned mode.\n");
+        exit(1);
+    }
 
-    printf("create program\n");
-    cl_int err = 0;
-    switch(job)
-    {
-    case JOB_TYPE_MIXED:
-        prog = clCreateProgramWithSource(context, 1, &src_mix, nullptr, &err);
-        break;
-    case JOB_TYPE_SINE:
-        prog = clCreateProgramWithSource(context, 1, &src_sin, nullptr, &err);
-        break;
-    case JOB_TYPE_TANGENT:
-        prog = clCreateProgramWithSource(context, 1, &src_tan, nullptr, &err);
-        break;
-    default:
-        abort();
+    if (out_of_order && !batch_size)
+    {
+        fprintf(stderr, "--out-of-order only applies to batched runs.\n");
+        exit(1);
     }
-    if (err != CL_SUCCESS)
+
+    if (replay && mode != BUFFER_MODE_PINNED)
     {
-        printf("failed to create program with error: %d\n", err);
+        fprintf(stderr, "replay requires pinned mode.\n");
         exit(1);
     }
 
-    printf("build program\n");
-    err = clBuildProgram(prog, 1, &dev, "", nullptr, nullptr);
-    if (err != CL_SUCCESS)
+    if (stream_tile < 0)
     {
-        printf("failed to build program: %d\n", err);
-        clGetProgramBuildInfo(prog, dev, CL_PROGRAM_BUILD_LOG, 8192, build_log, nullptr);
-        printf("%s\n", build_log);
+        fprintf(stderr, "invalid stream tile: %lld, must >= 0\n", (long long) stream_tile);
         exit(1);
     }
 
-    printf("create kernel\n");
-    err = 0;
-    kern = clCreateKernel(prog, "hello", &err);
-    if (err != CL_SUCCESS)
+    if (stream_tile && stream_depth < 2)
     {
-        printf("failed to create kernel with error: %d\n", err);
+        fprintf(stderr, "invalid stream depth: %d, must > 1\n", stream_depth);
         exit(1);
     }
-}
 
-void create_cmd_queue()
-{
-    if (mode == BUFFER_MODE_DUMMY) return;
+    if (stream_tile && mode != BUFFER_MODE_PINNED)
+    {
+        fprintf(stderr, "streaming requires pinned mode.\n");
+        exit(1);
+    }
 
-    printf("create command queue\n");
-    cl_int err = 0;
-    cmd_queue = clCreateCommandQueue(context, dev, 0, &err);
-    if (err != CL_SUCCESS)
+    if (stream_tile && (pipeline_depth || async_depth || replay || batch_size || co_exec || fused || multi_device ||
+                        do_autotune || do_profile))
     {
-        printf("failed to create command queue with error %d\n", err);
+        fprintf(stderr, "streaming replaces the whole-job serial run, and can not be combined with "
+                        "pipelined, async, replay, batched, co-execution, fused, multi-device, autotune or "
+                        "profiling runs.\n");
         exit(1);
     }
-}
 
-void send_input()
-{
-    if (mode == BUFFER_MODE_DUMMY) return;
+    if (fused && mode != BUFFER_MODE_PINNED)
+    {
+        fprintf(stderr, "fused run requires pinned mode.\n");
+        exit(1);
+    }
 
-    cl_int err = 0;
+    if (compare_storage.size() && mode != BUFFER_MODE_HOST_MAP && mode != BUFFER_MODE_DEVICE_MAP && mode != BUFFER_MODE_PINNED)
+    {
+        fprintf(stderr, "storage runs require hostmap, devicemap or pinned mode.\n");
+        exit(1);
+    }
 
-    if (mode == BUFFER_MODE_HOST_MAP)
+    if (compare_storage.size() && stream_tile)
     {
-        pinned_input = clEnqueueMapBuffer(cmd_queue, buf_input_host, true, CL_MAP_WRITE,
-                                          0, sizeof(float) * num_sample,
-                                          0, nullptr, nullptr,
-                                          &err);
-        if (err != CL_SUCCESS)
-        {
-            std::fprintf(stderr, "failed to map host-side input buffer: %d\n", err);
-            std::exit(1);
-        }
+        fprintf(stderr, "storage runs can not be combined with streaming.\n");
+        exit(1);
+    }
 
-        memcpy(pinned_input, data_input, sizeof(float) * num_sample);
+    if (input_dist == INPUT_DIST_INVALID || input_source == INPUT_SOURCE_INVALID)
+    {
+        fprintf(stderr, "input distribution or source is invalid.\n");
+        exit(1);
+    }
 
-        clEnqueueUnmapMemObject(cmd_queue, buf_input_host, pinned_input,
-                                0, nullptr, nullptr);
-        if (err != CL_SUCCESS)
-        {
-            std::fprintf(stderr, "failed to unmap host-side input buffer: %d\n", err);
-            std::exit(1);
-        }
+    if (input_source != INPUT_SOURCE_HOST && mode == BUFFER_MODE_DUMMY)
+    {
+        fprintf(stderr, "device or resident input requires a device buffer mode.\n");
+        exit(1);
     }
-    else if (mode == BUFFER_MODE_DEVICE_MAP)
+
+    if (input_source != INPUT_SOURCE_HOST &&
+        (pipeline_depth || async_depth || replay || batch_size || stream_tile || co_exec || fused || multi_device ||
+         compare_storage.size()))
     {
-        pinned_input = clEnqueueMapBuffer(cmd_queue, buf_input_dev, true, CL_MAP_WRITE,
-                                          0, sizeof(float) * num_sample,
-                                          0, nullptr, nullptr,
-                                          &err);
-        if (err != CL_SUCCESS)
-        {
-            std::fprintf(stderr, "failed to map device-side input buffer: %d\n", err);
-            std::exit(1);
-        }
+        fprintf(stderr, "device or resident input only applies to the serial run, and can not be combined with "
+                        "pipelined, async, replay, batched, streaming, co-execution, fused, multi-device or "
+                        "storage runs.\n");
+        exit(1);
+    }
 
-        memcpy(pinned_input, data_input, sizeof(float) * num_sample);
+    if (do_profile && mode == BUFFER_MODE_DUMMY)
+    {
+        fprintf(stderr, "profiling requires a device buffer mode.\n");
+        exit(1);
+    }
 
-        err = clEnqueueUnmapMemObject(cmd_queue, buf_input_dev, pinned_input,
-                                      0, nullptr, nullptr);
-        if (err != CL_SUCCESS)
+    {
+        std::string text = formula_text.length() ? formula_text : job_expression(job);
+        std::string error;
+        if (!formula.parse(text, error))
         {
-            std::fprintf(stderr, "failed to unmap device-side input buffer: %d\n", err);
-            std::exit(1);
+            fprintf(stderr, "invalid formula \"%s\": %s\n", text.c_str(), error.c_str());
+            exit(1);
         }
     }
-    else if (mode == BUFFER_MODE_PINNED)
+
+    if (kernel_layout == KERNEL_LAYOUT_INVALID)
     {
-        memcpy(pinned_input, data_input, sizeof(float) * num_sample);
+        fprintf(stderr, "kernel layout is invalid.\n");
+        exit(1);
+    }
 
-        err = clEnqueueWriteBuffer(cmd_queue, buf_input_dev, true,
-                                   0, sizeof(float) * num_sample, pinned_input,
-                                   0, nullptr, nullptr);
+    if (local_size_opt < 0)
+    {
+        fprintf(stderr, "invalid local size: %d, must >= 0\n", local_size_opt);
+        exit(1);
+    }
+
+    if (do_autotune && local_size_opt)
+    {
+        fprintf(stderr, "--autotune chooses local size itself, do not give --local-size.\n");
+        exit(1);
+    }
+
+    if (do_autotune && mode == BUFFER_MODE_DUMMY)
+    {
+        fprintf(stderr, "autotune requires a device buffer mode.\n");
+        exit(1);
+    }
+
+    if (result_format == REPORT_FORMAT_INVALID)
+    {
+        fprintf(stderr, "output format is invalid.\n");
+        exit(1);
+    }
+}
+
+void create_context()
+{
+    if (mode == BUFFER_MODE_DUMMY) return;
+
+    cl_context_properties context_props[] = {
+        CL_CONTEXT_PLATFORM, cl_context_properties(plat),
+        0, 0
+    };
+    cl_int err = 0;
+    context = clCreateContext(context_props, 1, &dev, nullptr, nullptr, &err);
+    if (err != CL_SUCCESS)
+    {
+        std::fprintf(stderr, "failed to create context: %d\n", err);
+        std::exit(1);
+    }
+    buffer_pool = new BufferPool(context, !no_buffer_pool);
+}
+
+cl_mem acquire_buffer(cl_mem_flags flags, size_t size, const char* desc)
+{
+    cl_int err = 0;
+    cl_mem re = buffer_pool->acquire(flags, size, err);
+    if (err != CL_SUCCESS)
+    {
+        std::fprintf(stderr, "failed to create %s buffer: %d\n", desc, err);
+        std::exit(1);
+    }
+    return re;
+}
+
+// cache line by default, raised to page or device base alignment in zero-copy mode
+size_t host_array_align = 64;
+
+// node of the host arrays and the driving thread, and how it was chosen:
+// option, device or default; -1 with NUMA placement off
+int numa_node = -1;
+std::string numa_node_source = "none";
+std::string dev_pci_address;
+
+void setup_numa()
+{
+    if (numa_policy == NUMA_POLICY_NONE) return;
+
+    int num_nodes = get_num_numa_nodes();
+    if (dev)
+        dev_pci_address = get_dev_pci_address(dev);
+
+    if (numa_node_opt >= 0)
+    {
+        if (numa_node_opt >= num_nodes)
+        {
+            std::fprintf(stderr, "invalid NUMA node: %d, there are %d\n", numa_node_opt, num_nodes);
+            std::exit(1);
+        }
+        numa_node = numa_node_opt;
+        numa_node_source = "option";
+    }
+    else
+    {
+        numa_node = get_pci_numa_node(dev_pci_address);
+        numa_node_source = "device";
+        if (numa_node < 0 || numa_node >= num_nodes)
+        {
+            numa_node = 0;
+            numa_node_source = "default";
+        }
+    }
+
+    std::string error;
+    if (!pin_thread_to_numa_node(numa_node, error))
+    {
+        std::fprintf(stderr, "failed to pin driving thread to NUMA node %d: %s\n", numa_node, error.c_str());
+        std::exit(1);
+    }
+    printf("host arrays and driving thread on NUMA node %d of %d (%s), device PCI %s\n",
+           numa_node, num_nodes, numa_node_source.c_str(),
+           dev_pci_address.length() ? dev_pci_address.c_str() : "unknown");
+}
+
+// zero-copy buffers must cover whole alignment units
+size_t host_array_size()
+{
+    size_t size = num_sample * sizeof(float);
+    return (size + host_array_align - 1) / host_array_align * host_array_align;
+}
+
+void alloc_host_arrays()
+{
+    if (mode == BUFFER_MODE_ZERO_COPY || sweep_max)
+    {
+        cl_uint base_align_bits = 0;
+        clGetDeviceInfo(dev, CL_DEVICE_MEM_BASE_ADDR_ALIGN, sizeof(cl_uint), &base_align_bits, nullptr);
+        host_array_align = 4096;
+        if (base_align_bits / 8 > host_array_align)
+            host_array_align = base_align_bits / 8;
+    }
+
+    // mbind works on whole pages
+    if (numa_policy == NUMA_POLICY_MBIND && host_array_align < 4096)
+        host_array_align = 4096;
+
+    data_input = (float*) aligned_host_alloc(host_array_align, host_array_size());
+    data_result = (float*) aligned_host_alloc(host_array_align, host_array_size());
+    if (!data_input || !data_result)
+    {
+        std::fprintf(stderr, "failed to allocate %lu bytes of host arrays\n", (unsigned long) host_array_size());
+        std::exit(1);
+    }
+
+    if (numa_policy == NUMA_POLICY_MBIND)
+    {
+        std::string error;
+        if (!bind_numa_memory(data_input, host_array_size(), numa_node, error) ||
+            !bind_numa_memory(data_result, host_array_size(), numa_node, error))
+        {
+            std::fprintf(stderr, "failed to bind host arrays to NUMA node %d: %s\n", numa_node, error.c_str());
+            std::exit(1);
+        }
+    }
+
+    // fault every page in from the pinned thread, which places them on its
+    // node under first touch, and on the bound node under mbind
+    if (numa_policy != NUMA_POLICY_NONE)
+    {
+        memset(data_input, 0, host_array_size());
+        memset(data_result, 0, host_array_size());
+    }
+}
+
+// bytes of the samples in the main device buffers
+size_t sample_bytes()
+{
+    return size_t(num_sample) * get_storage_size(storage);
+}
+
+template<typename T>
+void store_input_as(void* dst)
+{
+    StorageTraits<T>::from_float(data_input, static_cast<T*>(dst), num_sample);
+}
+
+template<typename T>
+void load_result_as(const void* src)
+{
+    StorageTraits<T>::to_float(static_cast<const T*>(src), data_result, num_sample);
+}
+
+// copy host input into a mapped or staging buffer, converting to the storage type
+void store_input(void* dst)
+{
+    double t0 = now_us();
+    switch (storage)
+    {
+    case STORAGE_FP32: store_input_as<cl_float>(dst); return;
+    case STORAGE_FP16: store_input_as<cl_half>(dst); break;
+    case STORAGE_FP64: store_input_as<cl_double>(dst); break;
+    default: abort();
+    }
+    time_convert.add(now_us() - t0);
+}
+
+void load_result(const void* src)
+{
+    double t0 = now_us();
+    switch (storage)
+    {
+    case STORAGE_FP32: load_result_as<cl_float>(src); return;
+    case STORAGE_FP16: load_result_as<cl_half>(src); break;
+    case STORAGE_FP64: load_result_as<cl_double>(src); break;
+    default: abort();
+    }
+    time_convert.add(now_us() - t0);
+}
+
+void create_buffer_object()
+{
+    if (mode == BUFFER_MODE_DUMMY) return;
+
+    cl_int err = 0;
+    printf("create buffers in context %p\n", context);
+
+    if (mode == BUFFER_MODE_HOST_MAP)
+    {
+        // buffers are created at host side, and are mapped when need to be used
+        buf_input_host = acquire_buffer(CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR, sample_bytes(), "host-side input");
+        buf_result_host = acquire_buffer(CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR, sample_bytes(), "host-side result");
+    }
+    else if (mode == BUFFER_MODE_DEVICE_MAP)
+    {
+        // buffers are created at device side, and are mapped when need to be used
+        buf_input_dev = acquire_buffer(CL_MEM_READ_ONLY, sample_bytes(), "device-side input");
+        buf_result_dev = acquire_buffer(CL_MEM_WRITE_ONLY, sample_bytes(), "device-side result");
+    }
+    else if (mode == BUFFER_MODE_ZERO_COPY)
+    {
+        // buffers wrap the host arrays directly, so that CPU devices and
+        // integrated GPUs can use them without any copy
+        err = 0;
+        buf_input_host = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, host_array_size(), data_input, &err);
+        if (err != CL_SUCCESS)
+        {
+            std::fprintf(stderr, "failed to create zero-copy input buffer: %d\n", err);
+            std::exit(1);
+        }
+
+        err = 0;
+        buf_result_host = clCreateBuffer(context, CL_MEM_WRITE_ONLY | CL_MEM_USE_HOST_PTR, host_array_size(), data_result, &err);
+        if (err != CL_SUCCESS)
+        {
+            std::fprintf(stderr, "failed to create zero-copy result buffer: %d\n", err);
+            std::exit(1);
+        }
+    }
+    else if (mode == BUFFER_MODE_PINNED)
+    {
+        // According to Nvidia's best practice guide
+        // Buffers are created at both host and device side, and are mapped now.
+        // When transferring data, data referred by host-side pointer is read/write to device side buffer.
+
+        // input buffers
+        buf_input_host = acquire_buffer(CL_MEM_ALLOC_HOST_PTR, sample_bytes(), "host-side input");
+        buf_input_dev = acquire_buffer(CL_MEM_READ_ONLY, sample_bytes(), "device-side input");
+
+        pinned_input = clEnqueueMapBuffer(cmd_queue, buf_input_host, true, CL_MAP_WRITE,
+                                          0, sample_bytes(),
+                                          0, nullptr, nullptr,
+                                          &err);
+        if (err != CL_SUCCESS)
+        {
+            std::fprintf(stderr, "failed to map host-side input buffer: %d\n", err);
+            std::exit(1);
+        }
+
+        // result buffers
+        buf_result_host = acquire_buffer(CL_MEM_ALLOC_HOST_PTR, sample_bytes(), "host-side result");
+        buf_result_dev = acquire_buffer(CL_MEM_WRITE_ONLY, sample_bytes(), "device-side");
+
+        pinned_result = clEnqueueMapBuffer(cmd_queue, buf_result_host, true, CL_MAP_READ,
+                                           0, sample_bytes(),
+                                           0, nullptr, nullptr,
+                                           &err);
+        if (err != CL_SUCCESS)
+        {
+            std::fprintf(stderr, "failed to map host-side input buffer: %d\n", err);
+            std::exit(1);
+        }
+    }
+}
+
+void setup_launch()
+{
+    size_t max_local = 0;
+    size_t preferred_multiple = 0;
+    clGetKernelWorkGroupInfo(kern, dev, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &max_local, nullptr);
+    clGetKernelWorkGroupInfo(kern, dev, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, sizeof(size_t), &preferred_multiple, nullptr);
+
+    local_size = local_size_opt;
+    if (!local_size && kernel_layout == KERNEL_LAYOUT_SINGLE)
+        local_size = preferred_multiple ? preferred_multiple : 1;
+
+    if (local_size > max_local)
+    {
+        fprintf(stderr, "local size %lu exceeds kernel work-group size %lu\n",
+                (unsigned long) local_size, (unsigned long) max_local);
+        exit(1);
+    }
+
+    global_size = get_global_size(kernel_layout, num_sample, dim1_size, local_size);
+    printf("launch %s kernel with global size %lu, local size %lu\n",
+           htio2::to_string(kernel_layout).c_str(), (unsigned long) global_size, (unsigned long) local_size);
+}
+
+void create_program_kernel()
+{
+    if (mode == BUFFER_MODE_DUMMY) return;
+
+    printf("create and build program\n");
+    double t0 = now_us();
+    bool gen_input = (input_source == INPUT_SOURCE_DEVICE);
+    kernel_src = make_kernel_source(formula.to_opencl(storage == STORAGE_FP64), kernel_layout, "hello", storage, gen_input);
+    if (gen_input)
+        kernel_src = make_input_source(input_dist, input_seed) + kernel_src;
+
+    bool cache_hit = false;
+    prog = build_program_cached(context, dev, kernel_src, "", binary_cache_dir, cache_hit);
+    if (binary_cache_dir.length())
+        program_cache_state = cache_hit ? "hit" : "miss";
+
+    printf("create kernel\n");
+    cl_int err = 0;
+    kern = clCreateKernel(prog, "hello", &err);
+    if (err != CL_SUCCESS)
+    {
+        printf("failed to create kernel with error: %d\n", err);
+        exit(1);
+    }
+
+    time_program = now_us() - t0;
+    printf("program ready in %.3f ms, binary cache %s\n", time_program / 1000.0, program_cache_state.c_str());
+
+    setup_launch();
+}
+
+void create_cmd_queue()
+{
+    if (mode == BUFFER_MODE_DUMMY) return;
+
+    printf("create command queue\n");
+    cl_int err = 0;
+    cl_command_queue_properties props = do_profile ? CL_QUEUE_PROFILING_ENABLE : 0;
+    cmd_queue = clCreateCommandQueue(context, dev, props, &err);
+    if (err != CL_SUCCESS)
+    {
+        printf("failed to create command queue with error %d\n", err);
+        exit(1);
+    }
+}
+
+void send_input()
+{
+    if (mode == BUFFER_MODE_DUMMY) return;
+    if (input_source == INPUT_SOURCE_DEVICE) return;
+    if (input_source == INPUT_SOURCE_RESIDENT && input_uploaded) return;
+    input_uploaded = true;
+
+    cl_int err = 0;
+    cl_event ev = nullptr;
+
+    if (mode == BUFFER_MODE_HOST_MAP)
+    {
+        pinned_input = clEnqueueMapBuffer(cmd_queue, buf_input_host, true, CL_MAP_WRITE,
+                                          0, sample_bytes(),
+                                          0, nullptr, profile_event(&ev),
+                                          &err);
+        if (err != CL_SUCCESS)
+        {
+            std::fprintf(stderr, "failed to map host-side input buffer: %d\n", err);
+            std::exit(1);
+        }
+        profile_record("map_input", ev);
+
+        store_input(pinned_input);
+
+        err = clEnqueueUnmapMemObject(cmd_queue, buf_input_host, pinned_input,
+                                      0, nullptr, profile_event(&ev));
+        if (err != CL_SUCCESS)
+        {
+            std::fprintf(stderr, "failed to unmap host-side input buffer: %d\n", err);
+            std::exit(1);
+        }
+        profile_record("unmap_input", ev);
+    }
+    else if (mode == BUFFER_MODE_DEVICE_MAP)
+    {
+        pinned_input = clEnqueueMapBuffer(cmd_queue, buf_input_dev, true, CL_MAP_WRITE,
+                                          0, sample_bytes(),
+                                          0, nullptr, profile_event(&ev),
+                                          &err);
+        if (err != CL_SUCCESS)
+        {
+            std::fprintf(stderr, "failed to map device-side input buffer: %d\n", err);
+            std::exit(1);
+        }
+        profile_record("map_input", ev);
+
+        store_input(pinned_input);
+
+        err = clEnqueueUnmapMemObject(cmd_queue, buf_input_dev, pinned_input,
+                                      0, nullptr, profile_event(&ev));
+        if (err != CL_SUCCESS)
+        {
+            std::fprintf(stderr, "failed to unmap device-side input buffer: %d\n", err);
+            std::exit(1);
+        }
+        profile_record("unmap_input", ev);
+    }
+    else if (mode == BUFFER_MODE_ZERO_COPY)
+    {
+        // no copy, the map/unmap pair only hands the host array over to the device
+        void* mapped = clEnqueueMapBuffer(cmd_queue, buf_input_host, true, CL_MAP_WRITE,
+                                          0, sample_bytes(),
+                                          0, nullptr, profile_event(&ev),
+                                          &err);
+        if (err != CL_SUCCESS)
+        {
+            std::fprintf(stderr, "failed to map zero-copy input buffer: %d\n", err);
+            std::exit(1);
+        }
+        profile_record("map_input", ev);
+
+        if (mapped != data_input)
+        {
+            std::fprintf(stderr, "zero-copy input buffer mapped to %p instead of host array %p\n", mapped, data_input);
+            std::exit(1);
+        }
+
+        err = clEnqueueUnmapMemObject(cmd_queue, buf_input_host, mapped,
+                                      0, nullptr, profile_event(&ev));
+        if (err != CL_SUCCESS)
+        {
+            std::fprintf(stderr, "failed to unmap zero-copy input buffer: %d\n", err);
+            std::exit(1);
+        }
+        profile_record("unmap_input", ev);
+    }
+    else if (mode == BUFFER_MODE_PINNED)
+    {
+        store_input(pinned_input);
+
+        err = clEnqueueWriteBuffer(cmd_queue, buf_input_dev, true,
+                                   0, sample_bytes(), pinned_input,
+                                   0, nullptr, profile_event(&ev));
+        if (err != CL_SUCCESS)
+        {
+            std::fprintf(stderr, "failed to write device-side input buffer: %d\n", err);
+            std::exit(1);
+        }
+        profile_record("write_input", ev);
+    }
+    else
+    {
+        abort();
+    }
+}
+
+void unmap_zero_copy_result()
+{
+    cl_event ev = nullptr;
+    cl_int err = clEnqueueUnmapMemObject(cmd_queue, buf_result_host, data_result,
+                                         0, nullptr, profile_event(&ev));
+    if (err != CL_SUCCESS)
+    {
+        std::fprintf(stderr, "failed to unmap zero-copy result buffer: %d\n", err);
+        std::exit(1);
+    }
+    profile_record("unmap_result", ev);
+    zero_copy_result_mapped = false;
+}
+
+void release_buffer_object()
+{
+    if (mode == BUFFER_MODE_DUMMY) return;
+
+    if (mode == BUFFER_MODE_PINNED && buf_input_host)
+    {
+        clEnqueueUnmapMemObject(cmd_queue, buf_input_host, pinned_input, 0, nullptr, nullptr);
+        clEnqueueUnmapMemObject(cmd_queue, buf_result_host, pinned_result, 0, nullptr, nullptr);
+    }
+    else if (mode == BUFFER_MODE_ZERO_COPY && zero_copy_result_mapped)
+    {
+        unmap_zero_copy_result();
+    }
+    clFinish(cmd_queue);
+
+    cl_mem* bufs[] = {&buf_input_host, &buf_input_dev, &buf_result_host, &buf_result_dev};
+    for (size_t i = 0; i < sizeof(bufs) / sizeof(bufs[0]); i++)
+    {
+        if (*bufs[i])
+        {
+            if (mode == BUFFER_MODE_ZERO_COPY)
+                clReleaseMemObject(*bufs[i]);
+            else
+                buffer_pool->release(*bufs[i]);
+        }
+        *bufs[i] = nullptr;
+    }
+    pinned_input = nullptr;
+    pinned_result = nullptr;
+    input_uploaded = false;
+}
+
+int64_t calc_chunk_size(int64_t n, size_t global)
+{
+    return (n + int64_t(global) - 1) / int64_t(global);
+}
+
+int64_t calc_chunk_size()
+{
+    return calc_chunk_size(num_sample, global_size);
+}
+
+// sample count and chunk size, 64-bit on both sides
+void set_range_args(cl_kernel k, int64_t n, int64_t chunk_size)
+{
+    cl_long arg_n = n;
+    cl_long arg_chunk = chunk_size;
+    clSetKernelArg(k, 2, sizeof(cl_long), &arg_n);
+    clSetKernelArg(k, 3, sizeof(cl_long), &arg_chunk);
+}
+
+void run()
+{
+    if (mode == BUFFER_MODE_DUMMY)
+    {
+        host_pool->parallel_for(num_sample, host_chunk, [](size_t begin, size_t end) {
+            formula.eval_host(data_input + begin, data_result + begin, end - begin);
+        });
+    }
+    else
+    {
+        cl_int err = 0;
+
+        int64_t chunk_size = calc_chunk_size();
+
+        if (zero_copy_result_mapped)
+            unmap_zero_copy_result();
+
+        if (mode == BUFFER_MODE_HOST_MAP || mode == BUFFER_MODE_ZERO_COPY)
+        {
+            err = clSetKernelArg(kern, 0, sizeof(cl_mem), &buf_input_host);
+            if (err != CL_SUCCESS)
+            {
+                printf("failed to set arg0 using host-side input buffer %p: %d\n", buf_input_host, err);
+                exit(1);
+            }
+
+            err = clSetKernelArg(kern, 1, sizeof(cl_mem), &buf_result_host);
+            if (err != CL_SUCCESS)
+            {
+                printf("failed to set arg0 using host-side result buffer %p\n: %d", buf_result_host, err);
+                exit(1);
+            }
+        }
+        else if (mode == BUFFER_MODE_DEVICE_MAP || mode == BUFFER_MODE_PINNED)
+        {
+            err = clSetKernelArg(kern, 0, sizeof(cl_mem), &buf_input_dev);
+            if (err != CL_SUCCESS)
+            {
+                printf("failed to set arg0 using device-side input buffer %p\n: %d", buf_input_dev, err);
+                exit(1);
+            }
+
+            err = clSetKernelArg(kern, 1, sizeof(cl_mem), &buf_result_dev);
+            if (err != CL_SUCCESS)
+            {
+                printf("failed to set arg0 using device-side result buffer %p\n: %d", buf_result_dev, err);
+                exit(1);
+            }
+        }
+
+        set_range_args(kern, num_sample, chunk_size);
+
+        cl_event ev = nullptr;
+        err = clEnqueueNDRangeKernel(cmd_queue, kern,
+                                     1,
+                                     nullptr, &global_size,
+                                     local_size ? &local_size : nullptr,
+                                     0, nullptr, profile_event(&ev));
+        if (err != CL_SUCCESS)
+        {
+            printf("failed to enqueue kernel with global size %lu, local size %lu: %d\n",
+                   (unsigned long) global_size, (unsigned long) local_size, err);
+            exit(1);
+        }
+        clFinish(cmd_queue);
+        profile_record("ndrange", ev);
+    }
+}
+
+void autotune_launch()
+{
+    TuneCache cache(tune_cache_file);
+    cache.load();
+    std::string key = TuneCache::make_key(get_dev_info_string(dev, CL_DEVICE_NAME),
+                                          get_dev_info_string(dev, CL_DRIVER_VERSION),
+                                          kernel_src, num_sample);
+
+    LaunchConfig best;
+    if (!do_retune && cache.lookup(key, best))
+    {
+        global_size = best.global_size;
+        local_size = best.local_size;
+        launch_source = "cache";
+        printf("use cached launch: global size %lu, local size %lu\n",
+               (unsigned long) global_size, (unsigned long) local_size);
+        return;
+    }
+
+    size_t max_local = 0;
+    size_t preferred_multiple = 0;
+    cl_uint num_cu = 0;
+    clGetKernelWorkGroupInfo(kern, dev, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &max_local, nullptr);
+    clGetKernelWorkGroupInfo(kern, dev, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, sizeof(size_t), &preferred_multiple, nullptr);
+    clGetDeviceInfo(dev, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &num_cu, nullptr);
+    if (!preferred_multiple) preferred_multiple = 1;
+    if (!num_cu) num_cu = 1;
+
+    // local sizes: runtime choice, then multiples of the preferred size
+    std::vector<size_t> locals;
+    if (kernel_layout != KERNEL_LAYOUT_SINGLE)
+        locals.push_back(0);
+    for (size_t l = preferred_multiple; l <= max_local; l *= 2)
+        locals.push_back(l);
+
+    // global sizes of the grid-stride layouts, this also sweeps chunk_size of
+    // the chunked layout; the single layout always covers all samples
+    std::vector<size_t> globals;
+    if (kernel_layout == KERNEL_LAYOUT_SINGLE)
+    {
+        globals.push_back(num_sample);
+    }
+    else
+    {
+        for (size_t g = preferred_multiple * num_cu; g < size_t(num_sample); g *= 2)
+            globals.push_back(g);
+        globals.push_back(dim1_size);
+    }
+
+    // tuning runs are not part of the profile
+    bool orig_profile = do_profile;
+    do_profile = false;
+    send_input();
+
+    best.time_us = std::numeric_limits<double>::max();
+    for (size_t i_local = 0; i_local < locals.size(); i_local++)
+    {
+        for (size_t i_global = 0; i_global < globals.size(); i_global++)
+        {
+            local_size = locals[i_local];
+            global_size = get_global_size(kernel_layout, num_sample, globals[i_global], local_size);
+
+            run(); // warm up
+            double time_min = std::numeric_limits<double>::max();
+            for (int rep = 0; rep < 3; rep++)
+            {
+                double t0 = now_us();
+                run();
+                double t = now_us() - t0;
+                if (t < time_min) time_min = t;
+            }
+
+            printf("  global %8lu  local %5lu  chunk %6lld: %10.3f us\n",
+                   (unsigned long) global_size, (unsigned long) local_size, (long long) calc_chunk_size(), time_min);
+            if (time_min < best.time_us)
+            {
+                best.global_size = global_size;
+                best.local_size = local_size;
+                best.time_us = time_min;
+            }
+        }
+    }
+    do_profile = orig_profile;
+
+    global_size = best.global_size;
+    local_size = best.local_size;
+    launch_source = "tuned";
+    printf("tuned launch: global size %lu, local size %lu\n", (unsigned long) global_size, (unsigned long) local_size);
+
+    cache.store(key, best);
+    cache.save();
+}
+
+void fetch_result()
+{
+    if (mode == BUFFER_MODE_DUMMY) return;
+
+    cl_int err = 0;
+    cl_event ev = nullptr;
+
+    if (mode == BUFFER_MODE_HOST_MAP)
+    {
+        pinned_result = clEnqueueMapBuffer(cmd_queue, buf_result_host, true, CL_MAP_READ,
+                                           0, sample_bytes(),
+                                           0, nullptr, profile_event(&ev),
+                                           &err);
+        if (err != CL_SUCCESS)
+        {
+            std::fprintf(stderr, "failed to map host-side result buffer: %d\n", err);
+            exit(1);
+        }
+        profile_record("map_result", ev);
+
+        load_result(pinned_result);
+
+        err = clEnqueueUnmapMemObject(cmd_queue, buf_result_host, pinned_result,
+                                      0, nullptr, profile_event(&ev));
+        if (err != CL_SUCCESS)
+        {
+            std::fprintf(stderr, "failed to unmap host-side result buffer: %d\n", err);
+            exit(1);
+        }
+        profile_record("unmap_result", ev);
+    }
+    else if (mode == BUFFER_MODE_DEVICE_MAP)
+    {
+        pinned_result = clEnqueueMapBuffer(cmd_queue, buf_result_dev, true, CL_MAP_READ,
+                                           0, sample_bytes(),
+                                           0, nullptr, profile_event(&ev),
+                                           &err);
+        if (err != CL_SUCCESS)
+        {
+            std::fprintf(stderr, "failed to map device-side result buffer: %d\n", err);
+            exit(1);
+        }
+        profile_record("map_result", ev);
+
+        load_result(pinned_result);
+
+        err = clEnqueueUnmapMemObject(cmd_queue, buf_result_dev, pinned_result,
+                                      0, nullptr, profile_event(&ev));
+        if (err != CL_SUCCESS)
+        {
+            std::fprintf(stderr, "failed to unmap device-side result buffer: %d\n", err);
+            exit(1);
+        }
+        profile_record("unmap_result", ev);
+    }
+    else if (mode == BUFFER_MODE_ZERO_COPY)
+    {
+        // mapped for both read and write, as the host clears results before the next run
+        void* mapped = clEnqueueMapBuffer(cmd_queue, buf_result_host, true, CL_MAP_READ | CL_MAP_WRITE,
+                                          0, sample_bytes(),
+                                          0, nullptr, profile_event(&ev),
+                                          &err);
+        if (err != CL_SUCCESS)
+        {
+            std::fprintf(stderr, "failed to map zero-copy result buffer: %d\n", err);
+            exit(1);
+        }
+        profile_record("map_result", ev);
+
+        if (mapped != data_result)
+        {
+            std::fprintf(stderr, "zero-copy result buffer mapped to %p instead of host array %p\n", mapped, data_result);
+            exit(1);
+        }
+        zero_copy_result_mapped = true;
+    }
+    else if (mode == BUFFER_MODE_PINNED)
+    {
+        err = clEnqueueReadBuffer(cmd_queue, buf_result_dev, true,
+                                  0, sample_bytes(), pinned_result,
+                                  0, nullptr, profile_event(&ev));
+        if (err != CL_SUCCESS)
+        {
+            std::fprintf(stderr, "failed to read device-side result buffer: %d\n", err);
+            exit(1);
+        }
+        profile_record("read_result", ev);
+
+        load_result(pinned_result);
+    }
+    else
+    {
+        abort();
+    }
+}
+
+void validate_result()
+{
+    validate_results(formula, data_input, data_result, num_sample,
+                     host_pool ? host_pool : validate_pool, validate_sample, validate_seed++, validate_stats,
+                     storage);
+}
+
+// move validation error collected since the last report into this one
+void add_validation(BenchReport& report)
+{
+    if (!validate_stats.count) return;
+    validate_stats.add_to_report(report);
+    validate_stats.clear();
+}
+
+void set_common_attrs(BenchReport& report)
+{
+    report.set_attr("mode", htio2::to_string(mode));
+    report.set_attr("job", formula_text.length() ? "formula" : htio2::to_string(job));
+    report.set_attr("formula", formula.get_text());
+    report.set_attr("formula_hash", formula.get_hash());
+    report.set_attr("layout", mode == BUFFER_MODE_DUMMY ? "host" : htio2::to_string(kernel_layout));
+    report.set_attr("storage", htio2::to_string(storage));
+    report.set_attr("input", htio2::to_string(input_dist));
+    report.set_attr("input_source", htio2::to_string(input_source));
+    report.set_attr("global_size", htio2::to_string(global_size));
+    report.set_attr("local_size", htio2::to_string(local_size));
+    report.set_attr("launch", launch_source);
+    report.set_attr("program_cache", program_cache_state);
+    report.set_attr("num_sample", htio2::to_string(num_sample));
+    report.set_attr("num_iter", htio2::to_string(num_iter));
+    report.set_attr("device", mode != BUFFER_MODE_DUMMY && dev ? get_dev_info_string(dev, CL_DEVICE_NAME) : "host");
+    report.set_attr("host_threads", htio2::to_string(mode == BUFFER_MODE_DUMMY && host_pool ? host_pool->get_num_threads() : 0));
+}
+
+void report_serial_run(double wall_us)
+{
+    BenchReport report;
+    set_common_attrs(report);
+    report.set_attr("exec", "serial");
+
+    report.add_phase("send", time_send.summarize());
+    report.add_phase("run", time_run.summarize());
+    report.add_phase("fetch", time_fetch.summarize());
+    if (time_convert.size())
+        report.add_phase("convert", time_convert.summarize());
+    if (time_validate.size())
+        report.add_phase("validate", time_validate.summarize());
+    report.add_phase("iteration", time_iter.summarize());
+
+    if (do_profile)
+    {
+        profiler.resolve();
+        profiler.add_to_report(report);
+    }
+
+    if (perf_counters)
+    {
+        report.set_attr("perf_counters", perf_counters->get_available_names());
+        report.set_attr("perf_scope", perf_counters->is_kernel_counted() ? "user+kernel" : "user");
+        perf_counters->add_to_report(report);
+    }
+
+    report.add_metric("startup_us", time_startup);
+    report.add_metric("program_us", time_program);
+    report.add_metric("wall_us", wall_us);
+    report.add_metric("samples_per_sec", double(num_sample) * num_iter / time_iter.total() * 1e6);
+    // input and result both move once per iteration, or only the result with
+    // device or resident input; bytes per us / 1e3 = GB/s. Dummy mode moves nothing.
+    if (mode != BUFFER_MODE_DUMMY)
+    {
+        double moved = (input_source == INPUT_SOURCE_HOST) ? 2.0 : 1.0;
+        report.add_metric("gb_per_sec", double(sample_bytes()) * num_iter * moved / time_iter.total() / 1e3);
+    }
+    add_validation(report);
+    reports.push_back(report);
+}
+
+void run_serial()
+{
+    printf("run %d times\n", num_iter);
+    time_send.clear();
+    time_run.clear();
+    time_fetch.clear();
+    time_validate.clear();
+    time_iter.clear();
+    time_convert.clear();
+    time_send.reserve(num_iter);
+    time_run.reserve(num_iter);
+    time_fetch.reserve(num_iter);
+    time_iter.reserve(num_iter);
+    if (perf_counters)
+        perf_counters->clear_phases();
+    profiler.clear();
+
+    // bytes the host copies into and out of device-visible memory, and those
+    // the host calculation reads and writes
+    bool host_copies = mode != BUFFER_MODE_DUMMY && mode != BUFFER_MODE_ZERO_COPY;
+    double bytes_send = (host_copies && input_source == INPUT_SOURCE_HOST) ? double(sample_bytes()) : 0.0;
+    double bytes_fetch = host_copies ? double(sample_bytes()) : 0.0;
+    double bytes_run = mode == BUFFER_MODE_DUMMY ? double(sizeof(float)) * num_sample * 2 : 0.0;
+    int64_t num_check = (validate_sample && validate_sample < num_sample) ? validate_sample : num_sample;
+    double bytes_validate = double(sizeof(float)) * num_check * 2;
+    PerfCounters::Values mark;
+
+    double wall_begin = now_us();
+    for (int cycle = 0; cycle < num_iter; cycle++)
+    {
+        // each phase is timed on its own, so that counter reads between
+        // phases are not charged to any of them
+        perf_mark(mark);
+        double t0 = now_us();
+        send_input();
+        double t1 = now_us();
+        perf_lap("send", bytes_send, mark);
+        double t_run = now_us();
+        run();
+        double t2 = now_us();
+        perf_lap("run", bytes_run, mark);
+        double t_fetch = now_us();
+        fetch_result();
+        double t3 = now_us();
+        perf_lap("fetch", bytes_fetch, mark);
+
+        time_send.add(t1 - t0);
+        time_run.add(t2 - t_run);
+        time_fetch.add(t3 - t_fetch);
+        time_iter.add((t1 - t0) + (t2 - t_run) + (t3 - t_fetch));
+
+        // profiling info of the iteration's commands, out of the timed phases
+        if (do_profile)
+            profiler.resolve();
+
+        // validate result
+        if (do_validate)
+        {
+            double t_validate = now_us();
+            validate_result();
+            time_validate.add(now_us() - t_validate);
+            perf_lap("validate", bytes_validate, mark);
+        }
+
+        // clear store
+        for (int64_t i = 0; i < num_sample; i++)
+        {
+            data_result[i] = 0.0f;
+        }
+    }
+
+    report_serial_run(now_us() - wall_begin);
+}
+
+//
+// pipelined execution
+// Each slot owns its own staging and device buffers. Uploads, kernels and
+// downloads go to three separate in-order queues and are chained by events,
+// so that the upload of iteration k+1 and the download of iteration k-1 are
+// not stuck behind the kernel of iteration k.
+//
+struct PipelineSlot
+{
+    cl_mem buf_input_host  = nullptr;
+    cl_mem buf_input_dev   = nullptr;
+    cl_mem buf_result_host = nullptr;
+    cl_mem buf_result_dev  = nullptr;
+    float* staging_input  = nullptr;
+    float* staging_result = nullptr;
+
+    cl_event ev_upload   = nullptr;
+    cl_event ev_kernel   = nullptr;
+    cl_event ev_download = nullptr;
+
+    double time_begin = 0.0;
+
+    // samples of the tile in flight, streaming only
+    int64_t begin = 0;
+    int64_t count = 0;
+};
+
+cl_mem create_pipeline_buffer(cl_mem_flags flags, size_t count, const char* desc)
+{
+    std::string name = std::string("pipeline ") + desc;
+    return acquire_buffer(flags, count * sizeof(float), name.c_str());
+}
+
+float* map_pipeline_buffer(cl_mem buf, cl_map_flags flags, size_t count, const char* desc)
+{
+    cl_int err = 0;
+    void* re = clEnqueueMapBuffer(cmd_queue, buf, true, flags,
+                                  0, sizeof(float) * count,
+                                  0, nullptr, nullptr,
+                                  &err);
+    if (err != CL_SUCCESS)
+    {
+        std::fprintf(stderr, "failed to map pipeline %s buffer: %d\n", desc, err);
+        std::exit(1);
+    }
+    return (float*) re;
+}
+
+cl_command_queue create_pipeline_queue()
+{
+    cl_int err = 0;
+    cl_command_queue re = clCreateCommandQueue(context, dev, 0, &err);
+    if (err != CL_SUCCESS)
+    {
+        printf("failed to create pipeline command queue with error %d\n", err);
+        exit(1);
+    }
+    return re;
+}
+
+void release_pipeline_events(PipelineSlot& slot)
+{
+    clReleaseEvent(slot.ev_upload);
+    clReleaseEvent(slot.ev_kernel);
+    clReleaseEvent(slot.ev_download);
+    slot.ev_upload = slot.ev_kernel = slot.ev_download = nullptr;
+}
+
+// validation and clearing of the result are added to time_excluded, so they
+// can be taken out of the throughput
+void complete_pipeline_slot(PipelineSlot& slot, LatencyRecorder& time_slot, double& time_excluded)
+{
+    cl_int err = clWaitForEvents(1, &slot.ev_download);
+    if (err != CL_SUCCESS)
+    {
+        std::fprintf(stderr, "failed to wait for pipelined download: %d\n", err);
+        std::exit(1);
+    }
+
+    release_pipeline_events(slot);
+
+    memcpy(data_result, slot.staging_result, sizeof(float) * num_sample);
+    double t_done = now_us();
+    time_slot.add(t_done - slot.time_begin);
+
+    if (do_validate)
+        validate_result();
+
+    for (int64_t i = 0; i < num_sample; i++)
+        data_result[i] = 0.0f;
+    time_excluded += now_us() - t_done;
+}
+
+// whole-job buffers and mapped staging of each slot
+void create_pipeline_slots(std::vector<PipelineSlot>& slots)
+{
+    for (size_t i = 0; i < slots.size(); i++)
+    {
+        PipelineSlot& slot = slots[i];
+        slot.buf_input_host  = create_pipeline_buffer(CL_MEM_ALLOC_HOST_PTR, num_sample, "host-side input");
+        slot.buf_input_dev   = create_pipeline_buffer(CL_MEM_READ_ONLY, num_sample, "device-side input");
+        slot.buf_result_host = create_pipeline_buffer(CL_MEM_ALLOC_HOST_PTR, num_sample, "host-side result");
+        slot.buf_result_dev  = create_pipeline_buffer(CL_MEM_WRITE_ONLY, num_sample, "device-side result");
+        slot.staging_input  = map_pipeline_buffer(slot.buf_input_host, CL_MAP_WRITE, num_sample, "host-side input");
+        slot.staging_result = map_pipeline_buffer(slot.buf_result_host, CL_MAP_READ, num_sample, "host-side result");
+    }
+}
+
+void release_pipeline_slots(std::vector<PipelineSlot>& slots)
+{
+    for (size_t i = 0; i < slots.size(); i++)
+    {
+        PipelineSlot& slot = slots[i];
+        clEnqueueUnmapMemObject(cmd_queue, slot.buf_input_host, slot.staging_input, 0, nullptr, nullptr);
+        clEnqueueUnmapMemObject(cmd_queue, slot.buf_result_host, slot.staging_result, 0, nullptr, nullptr);
+    }
+    clFinish(cmd_queue);
+    for (size_t i = 0; i < slots.size(); i++)
+    {
+        buffer_pool->release(slots[i].buf_input_host);
+        buffer_pool->release(slots[i].buf_input_dev);
+        buffer_pool->release(slots[i].buf_result_host);
+        buffer_pool->release(slots[i].buf_result_dev);
+    }
+}
+
+// upload the slot's staged input, run the kernel and download the result,
+// chained by events without blocking; the slot's ev_download marks the end
+void enqueue_pipeline_slot(PipelineSlot& slot, cl_command_queue queue_upload, cl_command_queue queue_compute,
+                           cl_command_queue queue_download, int64_t chunk_size)
+{
+    cl_int err = clEnqueueWriteBuffer(queue_upload, slot.buf_input_dev, false,
+                                      0, sizeof(float) * num_sample, slot.staging_input,
+                                      0, nullptr, &slot.ev_upload);
+    if (err != CL_SUCCESS)
+    {
+        std::fprintf(stderr, "failed to enqueue pipelined upload: %d\n", err);
+        std::exit(1);
+    }
+
+    clSetKernelArg(kern, 0, sizeof(cl_mem), &slot.buf_input_dev);
+    clSetKernelArg(kern, 1, sizeof(cl_mem), &slot.buf_result_dev);
+    set_range_args(kern, num_sample, chunk_size);
+    err = clEnqueueNDRangeKernel(queue_compute, kern,
+                                 1,
+                                 nullptr, &global_size,
+                                 local_size ? &local_size : nullptr,
+                                 1, &slot.ev_upload, &slot.ev_kernel);
+    if (err != CL_SUCCESS)
+    {
+        std::fprintf(stderr, "failed to enqueue pipelined kernel: %d\n", err);
+        std::exit(1);
+    }
+
+    err = clEnqueueReadBuffer(queue_download, slot.buf_result_dev, false,
+                              0, sizeof(float) * num_sample, slot.staging_result,
+                              1, &slot.ev_kernel, &slot.ev_download);
+    if (err != CL_SUCCESS)
+    {
+        std::fprintf(stderr, "failed to enqueue pipelined download: %d\n", err);
+        std::exit(1);
+    }
+
+    clFlush(queue_upload);
+    clFlush(queue_compute);
+    clFlush(queue_download);
+}
+
+void run_pipelined()
+{
+    printf("run %d times with %d iterations in flight\n", num_iter, pipeline_depth);
+
+    cl_command_queue queue_upload   = create_pipeline_queue();
+    cl_command_queue queue_compute  = create_pipeline_queue();
+    cl_command_queue queue_download = create_pipeline_queue();
+
+    std::vector<PipelineSlot> slots(pipeline_depth);
+    create_pipeline_slots(slots);
+
+    int64_t chunk_size = calc_chunk_size();
+    LatencyRecorder time_slot;
+    std::vector<double> time_complete;
+    time_slot.reserve(num_iter);
+    time_complete.reserve(num_iter);
+
+    // host time of validation and clearing, out of wall and steady throughput
+    double time_excluded = 0.0;
+
+    double wall_begin = now_us();
+    for (int cycle = 0; cycle < num_iter; cycle++)
+    {
+        PipelineSlot& slot = slots[cycle % pipeline_depth];
+        if (slot.ev_download)
+        {
+            complete_pipeline_slot(slot, time_slot, time_excluded);
+            time_complete.push_back(now_us() - time_excluded);
+        }
+
+        slot.time_begin = now_us();
+        memcpy(slot.staging_input, data_input, sizeof(float) * num_sample);
+        enqueue_pipeline_slot(slot, queue_upload, queue_compute, queue_download, chunk_size);
+    }
+
+    // drain in submission order
+    for (int cycle = num_iter; cycle < num_iter + pipeline_depth; cycle++)
+    {
+        PipelineSlot& slot = slots[cycle % pipeline_depth];
+        if (!slot.ev_download) continue;
+        complete_pipeline_slot(slot, time_slot, time_excluded);
+        time_complete.push_back(now_us() - time_excluded);
+    }
+    double wall_us = now_us() - wall_begin - time_excluded;
+
+    // steady state excludes the first round that fills the pipeline
+    double steady_samples_per_sec = double(num_sample) * num_iter / wall_us * 1e6;
+    if (num_iter > pipeline_depth)
+    {
+        double span = time_complete.back() - time_complete[pipeline_depth - 1];
+        steady_samples_per_sec = double(num_sample) * (num_iter - pipeline_depth) / span * 1e6;
+    }
+    double serial_samples_per_sec = double(num_sample) * num_iter / time_iter.total() * 1e6;
+
+    BenchReport report;
+    set_common_attrs(report);
+    report.set_attr("exec", "pipelined");
+    report.set_attr("pipeline_depth", htio2::to_string(pipeline_depth));
+    report.add_phase("iteration", time_slot.summarize());
+    report.add_metric("wall_us", wall_us);
+    report.add_metric("samples_per_sec", double(num_sample) * num_iter / wall_us * 1e6);
+    report.add_metric("steady_samples_per_sec", steady_samples_per_sec);
+    report.add_metric("serial_samples_per_sec", serial_samples_per_sec);
+    report.add_metric("speedup_vs_serial", steady_samples_per_sec / serial_samples_per_sec);
+    add_validation(report);
+    reports.push_back(report);
+
+    release_pipeline_slots(slots);
+    clReleaseCommandQueue(queue_upload);
+    clReleaseCommandQueue(queue_compute);
+    clReleaseCommandQueue(queue_download);
+}
+
+//
+// asynchronous requests
+// Every iteration is an independent request on a slot of the pipelined run.
+// Its upload, kernel and download are enqueued without blocking and chained
+// by events, and a callback on the download pushes the slot into a
+// CompletionQueue. The host thread never waits on a command: it refills
+// every free slot with a new request, then sleeps on the completion queue
+// until the runtime reports one done, copies that result out and reuses its
+// slot. Completions are handled in the order they arrive, not the order of
+// submission, like a service answering many clients would.
+//
+void run_async()
+{
+    printf("run %d requests with up to %d in flight, completed through event callbacks\n", num_iter, async_depth);
+
+    cl_command_queue queue_upload   = create_pipeline_queue();
+    cl_command_queue queue_compute  = create_pipeline_queue();
+    cl_command_queue queue_download = create_pipeline_queue();
+
+    std::vector<PipelineSlot> slots(async_depth);
+    create_pipeline_slots(slots);
+
+    std::vector<size_t> free_slots;
+    for (size_t i = 0; i < slots.size(); i++)
+        free_slots.push_back(slots.size() - 1 - i);
+
+    int64_t chunk_size = calc_chunk_size();
+    CompletionQueue completions;
+    LatencyRecorder time_request; // submission until the result is copied out
+    LatencyRecorder time_device;  // submission until the download callback
+    LatencyRecorder time_pickup;  // download callback until the host takes it
+    time_request.reserve(num_iter);
+    time_device.reserve(num_iter);
+    time_pickup.reserve(num_iter);
+    size_t max_in_flight = 0;
+
+    double wall_begin = now_us();
+    int num_submitted = 0;
+    for (int num_done = 0; num_done < num_iter; num_done++)
+    {
+        while (num_submitted < num_iter && free_slots.size())
+        {
+            size_t i_slot = free_slots.back();
+            free_slots.pop_back();
+            PipelineSlot& slot = slots[i_slot];
+
+            slot.time_begin = now_us();
+            memcpy(slot.staging_input, data_input, sizeof(float) * num_sample);
+            enqueue_pipeline_slot(slot, queue_upload, queue_compute, queue_download, chunk_size);
+
+            cl_int err = completions.watch(slot.ev_download, i_slot);
+            if (err != CL_SUCCESS)
+            {
+                std::fprintf(stderr, "failed to set async completion callback: %d\n", err);
+                std::exit(1);
+            }
+            num_submitted++;
+        }
+        max_in_flight = std::max(max_in_flight, completions.get_num_pending());
+
+        CompletionQueue::Completion done = completions.pop();
+        if (done.status != CL_COMPLETE)
+        {
+            std::fprintf(stderr, "async request failed: %d\n", done.status);
+            std::exit(1);
+        }
+
+        PipelineSlot& slot = slots[done.tag];
+        time_device.add(done.time_us - slot.time_begin);
+        time_pickup.add(now_us() - done.time_us);
+        release_pipeline_events(slot);
+
+        memcpy(data_result, slot.staging_result, sizeof(float) * num_sample);
+        time_request.add(now_us() - slot.time_begin);
+
+        if (do_validate)
+            validate_result();
+
+        for (int64_t i = 0; i < num_sample; i++)
+            data_result[i] = 0.0f;
+
+        free_slots.push_back(done.tag);
+    }
+    double wall_us = now_us() - wall_begin;
+
+    double samples_per_sec = double(num_sample) * num_iter / wall_us * 1e6;
+    double serial_samples_per_sec = double(num_sample) * num_iter / time_iter.total() * 1e6;
+
+    BenchReport report;
+    set_common_attrs(report);
+    report.set_attr("exec", "async");
+    report.set_attr("async_depth", htio2::to_string(async_depth));
+    report.add_phase("request", time_request.summarize());
+    report.add_phase("device_complete", time_device.summarize());
+    report.add_phase("callback_pickup", time_pickup.summarize());
+    report.add_metric("wall_us", wall_us);
+    report.add_metric("samples_per_sec", samples_per_sec);
+    report.add_metric("gb_per_sec", double(sizeof(float) * num_sample) * 2 * num_iter / wall_us / 1e3);
+    report.add_metric("max_in_flight", double(max_in_flight));
+    // the host thread is only idle while it waits for the next completion
+    report.add_metric("host_wait_us", completions.get_wait_us());
+    report.add_metric("host_busy_fraction", 1.0 - completions.get_wait_us() / wall_us);
+    report.add_metric("serial_samples_per_sec", serial_samples_per_sec);
+    report.add_metric("speedup_vs_serial", samples_per_sec / serial_samples_per_sec);
+    add_validation(report);
+    reports.push_back(report);
+
+    release_pipeline_slots(slots);
+    clReleaseCommandQueue(queue_upload);
+    clReleaseCommandQueue(queue_compute);
+    clReleaseCommandQueue(queue_download);
+}
+
+//
+// replay
+// Nothing changes between iterations, so the commands are recorded once:
+// upload from the pinned staging buffer, kernel, download back into it. With
+// cl_khr_command_buffer they go into a command buffer submitted by a single
+// call. Otherwise kernel arguments and launch size are set once, and an
+// iteration only issues the three enqueues and waits for the last one.
+//
+void run_replay()
+{
+    CommandBufferApi api;
+    const char* why_not = "";
+    bool use_command_buffer = api.load(plat, dev, why_not);
+    if (use_command_buffer)
+        printf("replay %d times with command buffer\n", num_iter);
+    else
+        printf("replay %d times with cached arguments, no command buffer: %s\n", num_iter, why_not);
+
+    size_t bytes = sizeof(float) * num_sample;
+    const size_t* local = local_size ? &local_size : nullptr;
+    clSetKernelArg(kern, 0, sizeof(cl_mem), &buf_input_dev);
+    clSetKernelArg(kern, 1, sizeof(cl_mem), &buf_result_dev);
+    set_range_args(kern, num_sample, calc_chunk_size());
+
+    // commands must not touch a mapped buffer, so with a command buffer the
+    // staging buffers it copies from and into are only mapped around the host
+    // copies of each iteration, and mapped again for the runs after replay.
+    // Cached arguments write and read through the host pointers, and keep the
+    // serial pinned run's mappings.
+    CommandBufferHandle cmd_buf = nullptr;
+    if (use_command_buffer)
+    {
+        clEnqueueUnmapMemObject(cmd_queue, buf_input_host, pinned_input, 0, nullptr, nullptr);
+        clEnqueueUnmapMemObject(cmd_queue, buf_result_host, pinned_result, 0, nullptr, nullptr);
+        clFinish(cmd_queue);
+        pinned_input = nullptr;
+        pinned_result = nullptr;
+
+        cl_int err = 0;
+        cmd_buf = api.create(1, &cmd_queue, nullptr, &err);
+        if (err != CL_SUCCESS)
+        {
+            std::fprintf(stderr, "failed to create command buffer: %d\n", err);
+            std::exit(1);
+        }
+
+        // commands of a command buffer are unordered unless chained by sync points
+        SyncPoint sync_upload = 0;
+        SyncPoint sync_kernel = 0;
+        err = api.copy_buffer(cmd_buf, nullptr, nullptr, buf_input_host, buf_input_dev, 0, 0, bytes,
+                              0, nullptr, &sync_upload, nullptr);
+        if (err == CL_SUCCESS)
+            err = api.ndrange_kernel(cmd_buf, nullptr, nullptr, kern, 1, nullptr, &global_size, local,
+                                     1, &sync_upload, &sync_kernel, nullptr);
+        if (err == CL_SUCCESS)
+            err = api.copy_buffer(cmd_buf, nullptr, nullptr, buf_result_dev, buf_result_host, 0, 0, bytes,
+                                  1, &sync_kernel, nullptr, nullptr);
+        if (err == CL_SUCCESS)
+            err = api.finalize(cmd_buf);
+        if (err != CL_SUCCESS)
+        {
+            std::fprintf(stderr, "failed to record command buffer: %d\n", err);
+            std::exit(1);
+        }
+    }
+
+    LatencyRecorder time_enqueue;
+    LatencyRecorder time_pass;
+    time_enqueue.reserve(num_iter);
+    time_pass.reserve(num_iter);
+
+    // one extra iteration up front as warm-up
+    for (int cycle = -1; cycle < num_iter; cycle++)
+    {
+        double t0 = now_us();
+        if (cmd_buf)
+        {
+            float* staging = map_pipeline_buffer(buf_input_host, CL_MAP_WRITE, num_sample, "replay input");
+            memcpy(staging, data_input, bytes);
+            clEnqueueUnmapMemObject(cmd_queue, buf_input_host, staging, 0, nullptr, nullptr);
+        }
+        else
+        {
+            memcpy(pinned_input, data_input, bytes);
+        }
+
+        double t1 = now_us();
+        cl_int err = 0;
+        cl_event ev_done = nullptr;
+        if (cmd_buf)
+        {
+            err = api.enqueue(1, &cmd_queue, cmd_buf, 0, nullptr, &ev_done);
+        }
+        else
+        {
+            err = clEnqueueWriteBuffer(cmd_queue, buf_input_dev, false, 0, bytes, pinned_input, 0, nullptr, nullptr);
+            if (err == CL_SUCCESS)
+                err = clEnqueueNDRangeKernel(cmd_queue, kern, 1, nullptr, &global_size, local, 0, nullptr, nullptr);
+            if (err == CL_SUCCESS)
+                err = clEnqueueReadBuffer(cmd_queue, buf_result_dev, false, 0, bytes, pinned_result, 0, nullptr, &ev_done);
+        }
+        if (err != CL_SUCCESS)
+        {
+            std::fprintf(stderr, "failed to enqueue replayed commands: %d\n", err);
+            std::exit(1);
+        }
+        double t2 = now_us();
+
+        err = clWaitForEvents(1, &ev_done);
+        if (err != CL_SUCCESS)
+        {
+            std::fprintf(stderr, "failed to wait for replayed commands: %d\n", err);
+            std::exit(1);
+        }
+        clReleaseEvent(ev_done);
+        if (cmd_buf)
+        {
+            float* staging = map_pipeline_buffer(buf_result_host, CL_MAP_READ, num_sample, "replay result");
+            memcpy(data_result, staging, bytes);
+            clEnqueueUnmapMemObject(cmd_queue, buf_result_host, staging, 0, nullptr, nullptr);
+        }
+        else
+        {
+            memcpy(data_result, pinned_result, bytes);
+        }
+        double t3 = now_us();
+
+        if (cycle < 0) continue;
+        time_enqueue.add(t2 - t1);
+        time_pass.add(t3 - t0);
+
+        if (do_validate)
+            validate_result();
+
+        for (int64_t i = 0; i < num_sample; i++)
+            data_result[i] = 0.0f;
+    }
+
+    double samples_per_sec = double(num_sample) * num_iter / time_pass.total() * 1e6;
+    double serial_samples_per_sec = double(num_sample) * num_iter / time_iter.total() * 1e6;
+
+    BenchReport report;
+    set_common_attrs(report);
+    report.set_attr("exec", "replay");
+    report.set_attr("replay_path", use_command_buffer ? "command_buffer" : "cached_args");
+    report.add_phase("enqueue", time_enqueue.summarize());
+    report.add_phase("iteration", time_pass.summarize());
+    report.add_metric("samples_per_sec", samples_per_sec);
+    report.add_metric("serial_samples_per_sec", serial_samples_per_sec);
+    report.add_metric("speedup_vs_serial", samples_per_sec / serial_samples_per_sec);
+    add_validation(report);
+    reports.push_back(report);
+
+    if (cmd_buf)
+    {
+        api.release(cmd_buf);
+        pinned_input = map_pipeline_buffer(buf_input_host, CL_MAP_WRITE, num_sample, "host-side input");
+        pinned_result = map_pipeline_buffer(buf_result_host, CL_MAP_READ, num_sample, "host-side result");
+    }
+}
+
+//
+// batched execution
+// A batch enqueues batch_size iterations of upload, kernel and download
+// without waiting in between, then waits once for its last download. On an
+// in-order queue the iterations share the serial run's buffers. On an
+// out-of-order queue they alternate between two device buffer sets, and
+// events keep each set's uses in order while the upload of one iteration may
+// overlap the kernel of the previous one. Downloads are chained, as they all
+// land in the same staging buffer.
+//
+struct BatchSlot
+{
+    cl_mem buf_input  = nullptr;
+    cl_mem buf_result = nullptr;
+    cl_event ev_kernel = nullptr; // last uses of this set
+    cl_event ev_read   = nullptr;
+};
+
+void release_event(cl_event& ev)
+{
+    if (ev) clReleaseEvent(ev);
+    ev = nullptr;
+}
+
+void run_batched()
+{
+    cl_int err = 0;
+    bool use_out_of_order = out_of_order;
+    cl_command_queue queue = cmd_queue;
+    if (use_out_of_order)
+    {
+        queue = clCreateCommandQueue(context, dev, CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE, &err);
+        if (err != CL_SUCCESS)
+        {
+            printf("out-of-order queue not supported (%d), use the in-order queue\n", err);
+            queue = cmd_queue;
+            use_out_of_order = false;
+        }
+    }
+
+    std::vector<BatchSlot> slots(use_out_of_order ? 2 : 1);
+    if (use_out_of_order)
+    {
+        for (size_t i = 0; i < slots.size(); i++)
+        {
+            slots[i].buf_input  = create_pipeline_buffer(CL_MEM_READ_ONLY, num_sample, "batch input");
+            slots[i].buf_result = create_pipeline_buffer(CL_MEM_WRITE_ONLY, num_sample, "batch result");
+        }
+    }
+    else
+    {
+        slots[0].buf_input  = buf_input_dev;
+        slots[0].buf_result = buf_result_dev;
+    }
+
+    size_t bytes = sizeof(float) * num_sample;
+    const size_t* local = local_size ? &local_size : nullptr;
+    set_range_args(kern, num_sample, calc_chunk_size());
+
+    // earlier runs may have left their own buffers bound to the kernel
+    clSetKernelArg(kern, 0, sizeof(cl_mem), &slots[0].buf_input);
+    clSetKernelArg(kern, 1, sizeof(cl_mem), &slots[0].buf_result);
+
+    int num_batch = (num_iter + batch_size - 1) / batch_size;
+    printf("run %d times in %d batches of %d on %s queue\n", num_iter, num_batch, batch_size,
+           use_out_of_order ? "an out-of-order" : "the in-order");
+
+    LatencyRecorder time_first;
+    LatencyRecorder time_batch;
+    time_first.reserve(num_batch);
+    time_batch.reserve(num_batch);
+
+    int iter_done = 0;
+    for (int i_batch = 0; i_batch < num_batch; i_batch++)
+    {
+        int iters = std::min(batch_size, num_iter - iter_done);
+        double t0 = now_us();
+
+        // input is the same for every iteration of the batch
+        memcpy(pinned_input, data_input, bytes);
+
+        cl_event ev_first = nullptr;
+        cl_event ev_last_read = nullptr;
+        for (int k = 0; k < iters; k++)
+        {
+            BatchSlot& slot = slots[k % slots.size()];
+
+            // the in-order queue orders everything by itself
+            std::vector<cl_event> wait_write;
+            std::vector<cl_event> wait_kernel;
+            std::vector<cl_event> wait_read;
+            if (use_out_of_order)
+            {
+                if (slot.ev_kernel) wait_write.push_back(slot.ev_kernel);
+                if (slot.ev_read) wait_kernel.push_back(slot.ev_read);
+                if (ev_last_read) wait_read.push_back(ev_last_read);
+            }
+
+            cl_event ev_write = nullptr;
+            cl_event ev_kernel = nullptr;
+            cl_event ev_read = nullptr;
+            err = clEnqueueWriteBuffer(queue, slot.buf_input, false, 0, bytes, pinned_input,
+                                       cl_uint(wait_write.size()), wait_write.empty() ? nullptr : &wait_write[0],
+                                       use_out_of_order ? &ev_write : nullptr);
+            if (err == CL_SUCCESS)
+            {
+                if (use_out_of_order)
+                {
+                    wait_kernel.push_back(ev_write);
+                    clSetKernelArg(kern, 0, sizeof(cl_mem), &slot.buf_input);
+                    clSetKernelArg(kern, 1, sizeof(cl_mem), &slot.buf_result);
+                }
+                err = clEnqueueNDRangeKernel(queue, kern, 1, nullptr, &global_size, local,
+                                             cl_uint(wait_kernel.size()), wait_kernel.empty() ? nullptr : &wait_kernel[0],
+                                             use_out_of_order ? &ev_kernel : nullptr);
+            }
+            if (err == CL_SUCCESS)
+            {
+                if (use_out_of_order) wait_read.push_back(ev_kernel);
+                err = clEnqueueReadBuffer(queue, slot.buf_result, false, 0, bytes, pinned_result,
+                                          cl_uint(wait_read.size()), wait_read.empty() ? nullptr : &wait_read[0],
+                                          &ev_read);
+            }
+            if (err != CL_SUCCESS)
+            {
+                std::fprintf(stderr, "failed to enqueue batched iteration: %d\n", err);
+                std::exit(1);
+            }
+
+            release_event(ev_write);
+            release_event(slot.ev_kernel);
+            release_event(slot.ev_read);
+            slot.ev_kernel = ev_kernel;
+            slot.ev_read = ev_read;
+            clRetainEvent(ev_read);
+
+            if (k == 0)
+            {
+                ev_first = ev_read;
+                clRetainEvent(ev_first);
+            }
+            release_event(ev_last_read);
+            ev_last_read = ev_read;
+        }
+        clFlush(queue);
+
+        err = clWaitForEvents(1, &ev_first);
+        double t_first = now_us();
+        if (err == CL_SUCCESS)
+            err = clWaitForEvents(1, &ev_last_read);
         if (err != CL_SUCCESS)
         {
-            std::fprintf(stderr, "failed to write device-side input buffer: %d\n", err);
+            std::fprintf(stderr, "failed to wait for batch: %d\n", err);
             std::exit(1);
         }
+        memcpy(data_result, pinned_result, bytes);
+        double t_end = now_us();
+
+        release_event(ev_first);
+        release_event(ev_last_read);
+        for (size_t i = 0; i < slots.size(); i++)
+        {
+            release_event(slots[i].ev_kernel);
+            release_event(slots[i].ev_read);
+        }
+
+        time_first.add(t_first - t0);
+        time_batch.add(t_end - t0);
+        iter_done += iters;
+
+        if (do_validate)
+            validate_result();
+
+        for (int64_t i = 0; i < num_sample; i++)
+            data_result[i] = 0.0f;
     }
-    else
+
+    double samples_per_sec = double(num_sample) * num_iter / time_batch.total() * 1e6;
+    double serial_samples_per_sec = double(num_sample) * num_iter / time_iter.total() * 1e6;
+
+    BenchReport report;
+    set_common_attrs(report);
+    report.set_attr("exec", "batched");
+    report.set_attr("batch_size", htio2::to_string(batch_size));
+    report.set_attr("queue", use_out_of_order ? "out_of_order" : "in_order");
+    report.add_phase("first_result", time_first.summarize());
+    report.add_phase("batch", time_batch.summarize());
+    report.add_metric("iteration_us", time_batch.total() / num_iter);
+    report.add_metric("samples_per_sec", samples_per_sec);
+    report.add_metric("serial_samples_per_sec", serial_samples_per_sec);
+    report.add_metric("speedup_vs_serial", samples_per_sec / serial_samples_per_sec);
+    add_validation(report);
+    reports.push_back(report);
+
+    if (use_out_of_order)
+    {
+        for (size_t i = 0; i < slots.size(); i++)
+        {
+            buffer_pool->release(slots[i].buf_input);
+            buffer_pool->release(slots[i].buf_result);
+        }
+        clReleaseCommandQueue(queue);
+    }
+}
+
+//
+// out-of-core streaming
+// The pipelined slots, but each one carries a tile of stream_tile samples
+// instead of the whole job. A ring of stream_depth slots is all the device
+// memory used, so the sample number is only bounded by host memory. While
+// the device works on one tile, the next is uploaded and the previous one
+// downloaded on their own queues, and the host copies tiles in and out of
+// the pinned staging buffers.
+//
+void complete_stream_tile(PipelineSlot& slot, LatencyRecorder& time_tile)
+{
+    cl_int err = clWaitForEvents(1, &slot.ev_download);
+    if (err != CL_SUCCESS)
+    {
+        std::fprintf(stderr, "failed to wait for streamed tile at %lld: %d\n", (long long) slot.begin, err);
+        std::exit(1);
+    }
+    release_pipeline_events(slot);
+
+    memcpy(data_result + slot.begin, slot.staging_result, sizeof(float) * slot.count);
+    time_tile.add(now_us() - slot.time_begin);
+}
+
+void enqueue_stream_tile(PipelineSlot& slot,
+                         cl_command_queue queue_upload, cl_command_queue queue_compute, cl_command_queue queue_download)
+{
+    slot.time_begin = now_us();
+    memcpy(slot.staging_input, data_input + slot.begin, sizeof(float) * slot.count);
+
+    cl_int err = clEnqueueWriteBuffer(queue_upload, slot.buf_input_dev, false,
+                                      0, sizeof(float) * slot.count, slot.staging_input,
+                                      0, nullptr, &slot.ev_upload);
+    if (err != CL_SUCCESS)
+    {
+        std::fprintf(stderr, "failed to enqueue tile upload: %d\n", err);
+        std::exit(1);
+    }
+
+    size_t tile_global = get_global_size(kernel_layout, slot.count, global_size, local_size);
+    clSetKernelArg(kern, 0, sizeof(cl_mem), &slot.buf_input_dev);
+    clSetKernelArg(kern, 1, sizeof(cl_mem), &slot.buf_result_dev);
+    set_range_args(kern, slot.count, calc_chunk_size(slot.count, tile_global));
+    err = clEnqueueNDRangeKernel(queue_compute, kern,
+                                 1,
+                                 nullptr, &tile_global,
+                                 local_size ? &local_size : nullptr,
+                                 1, &slot.ev_upload, &slot.ev_kernel);
+    if (err != CL_SUCCESS)
+    {
+        std::fprintf(stderr, "failed to enqueue tile kernel with global size %lu: %d\n", (unsigned long) tile_global, err);
+        std::exit(1);
+    }
+
+    err = clEnqueueReadBuffer(queue_download, slot.buf_result_dev, false,
+                              0, sizeof(float) * slot.count, slot.staging_result,
+                              1, &slot.ev_kernel, &slot.ev_download);
+    if (err != CL_SUCCESS)
+    {
+        std::fprintf(stderr, "failed to enqueue tile download: %d\n", err);
+        std::exit(1);
+    }
+
+    clFlush(queue_upload);
+    clFlush(queue_compute);
+    clFlush(queue_download);
+}
+
+void run_streaming()
+{
+    int64_t tile = std::min(stream_tile, num_sample);
+    int64_t num_tiles = (num_sample + tile - 1) / tile;
+    size_t device_bytes = size_t(stream_depth) * 2 * size_t(tile) * sizeof(float);
+    printf("run %d times in %lld tiles of %lld samples, %d in flight, %.1f MB device memory\n",
+           num_iter, (long long) num_tiles, (long long) tile, stream_depth, device_bytes / 1048576.0);
+
+    cl_command_queue queue_upload   = create_pipeline_queue();
+    cl_command_queue queue_compute  = create_pipeline_queue();
+    cl_command_queue queue_download = create_pipeline_queue();
+
+    std::vector<PipelineSlot> slots(stream_depth);
+    for (size_t i = 0; i < slots.size(); i++)
+    {
+        PipelineSlot& slot = slots[i];
+        slot.buf_input_host  = create_pipeline_buffer(CL_MEM_ALLOC_HOST_PTR, tile, "host-side input");
+        slot.buf_input_dev   = create_pipeline_buffer(CL_MEM_READ_ONLY, tile, "device-side input");
+        slot.buf_result_host = create_pipeline_buffer(CL_MEM_ALLOC_HOST_PTR, tile, "host-side result");
+        slot.buf_result_dev  = create_pipeline_buffer(CL_MEM_WRITE_ONLY, tile, "device-side result");
+        slot.staging_input  = map_pipeline_buffer(slot.buf_input_host, CL_MAP_WRITE, tile, "host-side input");
+        slot.staging_result = map_pipeline_buffer(slot.buf_result_host, CL_MAP_READ, tile, "host-side result");
+    }
+
+    LatencyRecorder time_pass;
+    LatencyRecorder time_tile;
+    time_pass.reserve(num_iter);
+    time_tile.reserve(size_t(num_tiles) * num_iter);
+
+    for (int cycle = 0; cycle < num_iter; cycle++)
+    {
+        double t0 = now_us();
+        for (int64_t i_tile = 0; i_tile < num_tiles; i_tile++)
+        {
+            PipelineSlot& slot = slots[i_tile % stream_depth];
+            if (slot.ev_download)
+                complete_stream_tile(slot, time_tile);
+
+            slot.begin = i_tile * tile;
+            slot.count = std::min(tile, num_sample - slot.begin);
+            enqueue_stream_tile(slot, queue_upload, queue_compute, queue_download);
+        }
+
+        // drain in submission order
+        for (int64_t i_tile = num_tiles; i_tile < num_tiles + stream_depth; i_tile++)
+        {
+            PipelineSlot& slot = slots[i_tile % stream_depth];
+            if (slot.ev_download)
+                complete_stream_tile(slot, time_tile);
+        }
+        time_pass.add(now_us() - t0);
+
+        if (do_validate)
+            validate_result();
+
+        for (int64_t i = 0; i < num_sample; i++)
+            data_result[i] = 0.0f;
+    }
+
+    double samples_per_sec = double(num_sample) * num_iter / time_pass.total() * 1e6;
+
+    BenchReport report;
+    set_common_attrs(report);
+    report.set_attr("exec", "streaming");
+    report.set_attr("stream_tile", htio2::to_string(tile));
+    report.set_attr("stream_depth", htio2::to_string(stream_depth));
+    report.add_phase("iteration", time_pass.summarize());
+    report.add_phase("tile", time_tile.summarize());
+    report.add_metric("startup_us", time_startup);
+    report.add_metric("tiles", double(num_tiles));
+    report.add_metric("device_bytes", double(device_bytes));
+    report.add_metric("samples_per_sec", samples_per_sec);
+    // input and result both cross the bus
+    report.add_metric("transfer_gb_per_sec", samples_per_sec * 2 * sizeof(float) / 1e9);
+    add_validation(report);
+    reports.push_back(report);
+
+    for (size_t i = 0; i < slots.size(); i++)
+    {
+        PipelineSlot& slot = slots[i];
+        clEnqueueUnmapMemObject(cmd_queue, slot.buf_input_host, slot.staging_input, 0, nullptr, nullptr);
+        clEnqueueUnmapMemObject(cmd_queue, slot.buf_result_host, slot.staging_result, 0, nullptr, nullptr);
+    }
+    clFinish(cmd_queue);
+    for (size_t i = 0; i < slots.size(); i++)
+    {
+        buffer_pool->release(slots[i].buf_input_host);
+        buffer_pool->release(slots[i].buf_input_dev);
+        buffer_pool->release(slots[i].buf_result_host);
+        buffer_pool->release(slots[i].buf_result_dev);
+    }
+    clReleaseCommandQueue(queue_upload);
+    clReleaseCommandQueue(queue_compute);
+    clReleaseCommandQueue(queue_download);
+}
+
+void run_host_scaling()
+{
+    size_t max_threads = host_pool->get_num_threads();
+    std::vector<size_t> thread_counts;
+    for (size_t n = 1; n < max_threads; n *= 2)
+        thread_counts.push_back(n);
+    thread_counts.push_back(max_threads);
+
+    double base_samples_per_sec = 0.0;
+    for (size_t i = 0; i < thread_counts.size(); i++)
+    {
+        HostThreadPool pool(thread_counts[i], pin_threads);
+        HostThreadPool* orig_pool = host_pool;
+        host_pool = &pool;
+
+        printf("run %d times with %lu host threads\n", num_iter, (unsigned long) thread_counts[i]);
+        run(); // warm up
+
+        LatencyRecorder time_pass;
+        for (int cycle = 0; cycle < num_iter; cycle++)
+        {
+            double t0 = now_us();
+            run();
+            time_pass.add(now_us() - t0);
+        }
+
+        double samples_per_sec = double(num_sample) * num_iter / time_pass.total() * 1e6;
+        if (i == 0) base_samples_per_sec = samples_per_sec;
+
+        BenchReport report;
+        set_common_attrs(report);
+        report.set_attr("exec", "host_scaling");
+        report.add_phase("run", time_pass.summarize());
+        report.add_metric("samples_per_sec", samples_per_sec);
+        report.add_metric("speedup_vs_1_thread", samples_per_sec / base_samples_per_sec);
+        report.add_metric("parallel_efficiency", samples_per_sec / base_samples_per_sec / thread_counts[i]);
+        report.add_metric("steals", double(pool.get_num_steals()));
+        reports.push_back(report);
+
+        host_pool = orig_pool;
+    }
+}
+
+//
+// multi-device execution
+// Every device of every platform gets its own context, queue, program and
+// buffers for one contiguous share of the samples. Shares are proportional to
+// the throughput each device reached alone in a calibration pass. Transfers
+// are part of that pass, so a fast device behind a slow bus is not given more
+// than it can return in time.
+//
+struct DeviceShard
+{
+    cl_platform_id plat = nullptr;
+    cl_device_id dev    = nullptr;
+    std::string name;
+
+    cl_context context     = nullptr;
+    cl_command_queue queue = nullptr;
+    cl_program prog = nullptr;
+    cl_kernel kern  = nullptr;
+    size_t max_global = 0;
+    size_t local_size = 0;
+
+    cl_mem buf_input  = nullptr;
+    cl_mem buf_result = nullptr;
+    size_t capacity = 0; // samples the buffers can hold
+
+    size_t begin = 0;
+    size_t count = 0;
+    double calib_samples_per_sec = 0.0;
+
+    cl_event ev_write = nullptr;
+    cl_event ev_read  = nullptr;
+
+    // write start to read end on the device clock
+    LatencyRecorder time_busy;
+};
+
+void setup_shard(DeviceShard& shard, const std::string& src)
+{
+    shard.name = get_dev_info_string(shard.dev, CL_DEVICE_NAME);
+
+    cl_context_properties context_props[] = {
+        CL_CONTEXT_PLATFORM, cl_context_properties(shard.plat),
+        0, 0
+    };
+    cl_int err = 0;
+    shard.context = clCreateContext(context_props, 1, &shard.dev, nullptr, nullptr, &err);
+    if (err != CL_SUCCESS)
+    {
+        std::fprintf(stderr, "failed to create context on %s: %d\n", shard.name.c_str(), err);
+        std::exit(1);
+    }
+
+    // profiling is always on, per-device busy time comes from event timestamps
+    shard.queue = clCreateCommandQueue(shard.context, shard.dev, CL_QUEUE_PROFILING_ENABLE, &err);
+    if (err != CL_SUCCESS)
+    {
+        std::fprintf(stderr, "failed to create command queue on %s: %d\n", shard.name.c_str(), err);
+        std::exit(1);
+    }
+
+    bool cache_hit = false;
+    shard.prog = build_program_cached(shard.context, shard.dev, src, "", binary_cache_dir, cache_hit);
+    shard.kern = clCreateKernel(shard.prog, "hello", &err);
+    if (err != CL_SUCCESS)
+    {
+        std::fprintf(stderr, "failed to create kernel on %s: %d\n", shard.name.c_str(), err);
+        std::exit(1);
+    }
+
+    cl_uint num_dim = 0;
+    clGetDeviceInfo(shard.dev, CL_DEVICE_MAX_WORK_ITEM_DIMENSIONS, sizeof(cl_uint), &num_dim, nullptr);
+    std::vector<size_t> dim_sizes(num_dim ? num_dim : 1, 1);
+    clGetDeviceInfo(shard.dev, CL_DEVICE_MAX_WORK_ITEM_SIZES, sizeof(size_t) * num_dim, &dim_sizes[0], nullptr);
+    shard.max_global = dim_sizes[0];
+
+    // same rule as setup_launch(), but a local size too large for this
+    // device falls back to the runtime's choice instead of failing
+    size_t max_local = 0;
+    size_t preferred_multiple = 0;
+    clGetKernelWorkGroupInfo(shard.kern, shard.dev, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &max_local, nullptr);
+    clGetKernelWorkGroupInfo(shard.kern, shard.dev, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, sizeof(size_t), &preferred_multiple, nullptr);
+    shard.local_size = local_size_opt;
+    if (!shard.local_size && kernel_layout == KERNEL_LAYOUT_SINGLE)
+        shard.local_size = preferred_multiple ? preferred_multiple : 1;
+    if (shard.local_size > max_local)
+        shard.local_size = (kernel_layout == KERNEL_LAYOUT_SINGLE) ? 1 : 0;
+}
+
+void reserve_shard_buffers(DeviceShard& shard, size_t count)
+{
+    if (shard.capacity >= count) return;
+
+    if (shard.buf_input) clReleaseMemObject(shard.buf_input);
+    if (shard.buf_result) clReleaseMemObject(shard.buf_result);
+
+    cl_int err = 0;
+    shard.buf_input = clCreateBuffer(shard.context, CL_MEM_READ_ONLY, count * sizeof(float), nullptr, &err);
+    if (err != CL_SUCCESS)
+    {
+        std::fprintf(stderr, "failed to create input buffer of %lu samples on %s: %d\n",
+                     (unsigned long) count, shard.name.c_str(), err);
+        std::exit(1);
+    }
+
+    shard.buf_result = clCreateBuffer(shard.context, CL_MEM_WRITE_ONLY, count * sizeof(float), nullptr, &err);
+    if (err != CL_SUCCESS)
+    {
+        std::fprintf(stderr, "failed to create result buffer of %lu samples on %s: %d\n",
+                     (unsigned long) count, shard.name.c_str(), err);
+        std::exit(1);
+    }
+    shard.capacity = count;
+}
+
+// upload, calculate and download samples [begin, begin + count) without blocking
+void enqueue_shard(DeviceShard& shard, size_t begin, size_t count)
+{
+    cl_int err = clEnqueueWriteBuffer(shard.queue, shard.buf_input, false,
+                                      0, count * sizeof(float), data_input + begin,
+                                      0, nullptr, &shard.ev_write);
+    if (err != CL_SUCCESS)
+    {
+        std::fprintf(stderr, "failed to write input to %s: %d\n", shard.name.c_str(), err);
+        std::exit(1);
+    }
+
+    size_t shard_global = get_global_size(kernel_layout, count, shard.max_global, shard.local_size);
+    clSetKernelArg(shard.kern, 0, sizeof(cl_mem), &shard.buf_input);
+    clSetKernelArg(shard.kern, 1, sizeof(cl_mem), &shard.buf_result);
+    set_range_args(shard.kern, count, calc_chunk_size(count, shard_global));
+    err = clEnqueueNDRangeKernel(shard.queue, shard.kern,
+                                 1,
+                                 nullptr, &shard_global,
+                                 shard.local_size ? &shard.local_size : nullptr,
+                                 0, nullptr, nullptr);
+    if (err != CL_SUCCESS)
+    {
+        std::fprintf(stderr, "failed to enqueue kernel with global size %lu on %s: %d\n",
+                     (unsigned long) shard_global, shard.name.c_str(), err);
+        std::exit(1);
+    }
+
+    err = clEnqueueReadBuffer(shard.queue, shard.buf_result, false,
+                              0, count * sizeof(float), data_result + begin,
+                              0, nullptr, &shard.ev_read);
+    if (err != CL_SUCCESS)
+    {
+        std::fprintf(stderr, "failed to read result from %s: %d\n", shard.name.c_str(), err);
+        std::exit(1);
+    }
+    clFlush(shard.queue);
+}
+
+// wait for the enqueued work, return its busy time in microseconds
+double complete_shard(DeviceShard& shard)
+{
+    cl_int err = clWaitForEvents(1, &shard.ev_read);
+    if (err != CL_SUCCESS)
+    {
+        std::fprintf(stderr, "failed to wait for %s: %d\n", shard.name.c_str(), err);
+        std::exit(1);
+    }
+
+    cl_ulong t_start = 0;
+    cl_ulong t_end = 0;
+    clGetEventProfilingInfo(shard.ev_write, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &t_start, nullptr);
+    clGetEventProfilingInfo(shard.ev_read, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &t_end, nullptr);
+    clReleaseEvent(shard.ev_write);
+    clReleaseEvent(shard.ev_read);
+    shard.ev_write = shard.ev_read = nullptr;
+
+    return (t_end > t_start) ? double(t_end - t_start) / 1000.0 : 0.0;
+}
+
+void run_multi_device()
+{
+    std::vector<cl_platform_id> plats;
+    std::vector<cl_device_id> devs;
+    get_all_platforms_and_devices(plats, devs);
+    if (devs.empty())
+    {
+        fprintf(stderr, "no OpenCL device for multi-device run\n");
+        exit(1);
+    }
+
+    std::string src = make_kernel_source(formula.to_opencl(), kernel_layout);
+    std::vector<DeviceShard> shards(devs.size());
+    for (size_t i = 0; i < shards.size(); i++)
+    {
+        shards[i].plat = plats[i];
+        shards[i].dev = devs[i];
+        setup_shard(shards[i], src);
+    }
+
+    // calibrate each device alone on the leading samples, best of 3 after a warm-up
+    size_t calib_count = std::min(size_t(num_sample), size_t(1) << 20);
+    double rate_sum = 0.0;
+    for (size_t i = 0; i < shards.size(); i++)
+    {
+        DeviceShard& shard = shards[i];
+        reserve_shard_buffers(shard, calib_count);
+
+        double time_min = std::numeric_limits<double>::max();
+        for (int rep = 0; rep < 4; rep++)
+        {
+            enqueue_shard(shard, 0, calib_count);
+            double t = complete_shard(shard);
+            if (rep && t < time_min) time_min = t;
+        }
+        if (time_min <= 0.0) time_min = 1.0;
+
+        shard.calib_samples_per_sec = double(calib_count) / time_min * 1e6;
+        rate_sum += shard.calib_samples_per_sec;
+        printf("  device %lu %s: %g samples/sec\n", (unsigned long) i, shard.name.c_str(), shard.calib_samples_per_sec);
+    }
+
+    // contiguous shares, boundaries rounded from the cumulative rate so that they sum up exactly
+    double rate_acc = 0.0;
+    for (size_t i = 0; i < shards.size(); i++)
+    {
+        DeviceShard& shard = shards[i];
+        shard.begin = size_t(std::llround(double(num_sample) * rate_acc / rate_sum));
+        rate_acc += shard.calib_samples_per_sec;
+        size_t end = (i + 1 == shards.size()) ? size_t(num_sample)
+                                              : size_t(std::llround(double(num_sample) * rate_acc / rate_sum));
+        shard.count = end - shard.begin;
+        if (shard.count) reserve_shard_buffers(shard, shard.count);
+        printf("  device %lu %s: samples [%lu, %lu)\n", (unsigned long) i, shard.name.c_str(),
+               (unsigned long) shard.begin, (unsigned long) end);
+    }
+
+    for (int64_t i = 0; i < num_sample; i++)
+        data_result[i] = 0.0f;
+
+    printf("run %d times on %lu devices\n", num_iter, (unsigned long) shards.size());
+    LatencyRecorder time_pass;
+    time_pass.reserve(num_iter);
+    for (int cycle = 0; cycle < num_iter; cycle++)
+    {
+        double t0 = now_us();
+        for (size_t i = 0; i < shards.size(); i++)
+        {
+            if (shards[i].count)
+                enqueue_shard(shards[i], shards[i].begin, shards[i].count);
+        }
+        for (size_t i = 0; i < shards.size(); i++)
+        {
+            if (shards[i].count)
+                shards[i].time_busy.add(complete_shard(shards[i]));
+        }
+        time_pass.add(now_us() - t0);
+
+        if (do_validate)
+            validate_result();
+
+        for (int64_t i = 0; i < num_sample; i++)
+            data_result[i] = 0.0f;
+    }
+
+    BenchReport report;
+    set_common_attrs(report);
+    report.set_attr("exec", "multi_device");
+    report.set_attr("device", htio2::to_string(shards.size()) + " devices");
+    report.set_attr("global_size", "per device");
+    report.set_attr("local_size", "per device");
+    report.add_phase("iteration", time_pass.summarize());
+
+    double busy_min = std::numeric_limits<double>::max();
+    double busy_max = 0.0;
+    for (size_t i = 0; i < shards.size(); i++)
+    {
+        const DeviceShard& shard = shards[i];
+        std::string prefix = "device" + htio2::to_string(i);
+        report.set_attr(prefix, shard.name);
+        report.add_metric(prefix + ".share", double(shard.count) / num_sample);
+        report.add_metric(prefix + ".calib_samples_per_sec", shard.calib_samples_per_sec);
+        if (!shard.count) continue;
+
+        double busy = shard.time_busy.total();
+        report.add_phase(prefix + ".busy", shard.time_busy.summarize());
+        report.add_metric(prefix + ".samples_per_sec", double(shard.count) * num_iter / busy * 1e6);
+        busy_min = std::min(busy_min, busy);
+        busy_max = std::max(busy_max, busy);
+    }
+
+    report.add_metric("samples_per_sec", double(num_sample) * num_iter / time_pass.total() * 1e6);
+    report.add_metric("calib_samples_per_sec_sum", rate_sum);
+    // 1 when all devices finish together
+    report.add_metric("balance", busy_max > 0.0 ? busy_min / busy_max : 1.0);
+    add_validation(report);
+    reports.push_back(report);
+
+    for (size_t i = 0; i < shards.size(); i++)
+    {
+        DeviceShard& shard = shards[i];
+        clReleaseMemObject(shard.buf_input);
+        clReleaseMemObject(shard.buf_result);
+        clReleaseKernel(shard.kern);
+        clReleaseProgram(shard.prog);
+        clReleaseCommandQueue(shard.queue);
+        clReleaseContext(shard.context);
+    }
+}
+
+//
+// host and device co-execution
+// Both sides claim sample ranges from one atomic counter. A claim is a share
+// of what is left, weighted by the claiming side's observed rate against the
+// combined rate, so chunks start large and shrink towards the end and both
+// sides run out of work at about the same time. The device keeps two chunks
+// in flight so that it is not idle while the host thread claims the next one.
+//
+struct CoExecState
+{
+    size_t n = 0;
+    std::atomic<size_t> next;
+
+    // observed throughput in samples per microsecond, 0 until the first chunk is done
+    std::atomic<double> host_rate;   // one host thread
+    std::atomic<double> device_rate;
+    size_t num_host_threads = 0;
+
+    std::atomic<size_t> host_samples;
+    std::atomic<size_t> host_chunks;
+    size_t device_samples = 0;
+    size_t device_chunks = 0;
+
+    // 1 / (rate-weighted claims per side); smaller means more, smaller chunks
+    static const size_t CLAIM_DIVISOR = 2;
+};
+
+// samples to claim for a side with rate_self out of the combined rate_total
+size_t coexec_chunk_size(const CoExecState& st, double rate_self, double rate_total,
+                         size_t min_chunk, size_t max_chunk)
+{
+    size_t claimed = st.next.load(std::memory_order_relaxed);
+    if (claimed >= st.n) return min_chunk;
+    if (rate_self <= 0.0 || rate_total <= 0.0) return min_chunk;
+
+    size_t remain = st.n - claimed;
+    size_t re = size_t(double(remain) * rate_self / rate_total / CoExecState::CLAIM_DIVISOR);
+    return std::max(min_chunk, std::min(max_chunk, re));
+}
+
+// claim [begin, end) of at most chunk samples, false when nothing is left
+bool coexec_claim(CoExecState& st, size_t chunk, size_t& begin, size_t& end)
+{
+    begin = st.next.fetch_add(chunk);
+    if (begin >= st.n) return false;
+    end = std::min(begin + chunk, st.n);
+    return true;
+}
+
+// host threads all fold their chunks into the one host rate, so the update
+// retries until no other thread changed it in between
+void update_rate(std::atomic<double>& rate, double samples, double time_us)
+{
+    if (time_us <= 0.0) return;
+    double observed = samples / time_us;
+    double old = rate.load();
+    while (!rate.compare_exchange_weak(old, old > 0.0 ? 0.5 * old + 0.5 * observed : observed))
+    {
+    }
+}
+
+double coexec_total_rate(const CoExecState& st)
+{
+    return st.host_rate.load() * st.num_host_threads + st.device_rate.load();
+}
+
+void coexec_host_worker(CoExecState& st)
+{
+    size_t chunks = 0;
+    size_t samples = 0;
+    for (;;)
+    {
+        size_t chunk = coexec_chunk_size(st, st.host_rate.load(), coexec_total_rate(st), host_chunk, st.n);
+        size_t begin = 0;
+        size_t end = 0;
+        if (!coexec_claim(st, chunk, begin, end)) break;
+
+        double t0 = now_us();
+        formula.eval_host(data_input + begin, data_result + begin, end - begin);
+        update_rate(st.host_rate, double(end - begin), now_us() - t0);
+        chunks++;
+        samples += end - begin;
+    }
+    st.host_chunks += chunks;
+    st.host_samples += samples;
+}
+
+struct CoExecSlot
+{
+    cl_mem buf_input  = nullptr;
+    cl_mem buf_result = nullptr;
+    size_t begin = 0;
+    size_t end = 0;
+    cl_event ev_read = nullptr;
+};
+
+void coexec_enqueue(CoExecSlot& slot)
+{
+    size_t count = slot.end - slot.begin;
+    cl_int err = clEnqueueWriteBuffer(cmd_queue, slot.buf_input, false,
+                                      0, count * sizeof(float), data_input + slot.begin,
+                                      0, nullptr, nullptr);
+    if (err != CL_SUCCESS)
+    {
+        std::fprintf(stderr, "failed to write co-execution input: %d\n", err);
+        std::exit(1);
+    }
+
+    size_t chunk_global = get_global_size(kernel_layout, count, global_size, local_size);
+    clSetKernelArg(kern, 0, sizeof(cl_mem), &slot.buf_input);
+    clSetKernelArg(kern, 1, sizeof(cl_mem), &slot.buf_result);
+    set_range_args(kern, count, calc_chunk_size(count, chunk_global));
+    err = clEnqueueNDRangeKernel(cmd_queue, kern,
+                                 1,
+                                 nullptr, &chunk_global,
+                                 local_size ? &local_size : nullptr,
+                                 0, nullptr, nullptr);
+    if (err != CL_SUCCESS)
+    {
+        std::fprintf(stderr, "failed to enqueue co-execution kernel with global size %lu: %d\n",
+                     (unsigned long) chunk_global, err);
+        std::exit(1);
+    }
+
+    err = clEnqueueReadBuffer(cmd_queue, slot.buf_result, false,
+                              0, count * sizeof(float), data_result + slot.begin,
+                              0, nullptr, &slot.ev_read);
+    if (err != CL_SUCCESS)
     {
-        abort();
+        std::fprintf(stderr, "failed to read co-execution result: %d\n", err);
+        std::exit(1);
     }
+    clFlush(cmd_queue);
 }
 
-void run()
+void coexec_device_driver(CoExecState& st, CoExecSlot* slots, size_t min_chunk, size_t max_chunk)
 {
-    if (mode == BUFFER_MODE_DUMMY)
+    size_t num_active = 0;
+    size_t cur = 0;
+    double t_last = now_us();
+
+    for (;;)
     {
-        if (job == JOB_TYPE_SINE)
-        {
-            for (int i = 0; i < num_sample; i++)
-            {
-                float curr = data_input[i];
-                data_result[i] = std::sin(curr) + std::sin(2.0*curr) + std::sin(curr*curr) + std::sin(curr+0.5);
-            }
-        }
-        else if (job == JOB_TYPE_TANGENT)
-        {
-            for (int i = 0; i < num_sample; i++)
-            {
-                float curr = data_input[i];
-                data_result[i] = std::tan(curr) + std::tan(2.0*curr) + std::tan(curr*curr) + std::tan(curr+0.5);
-            }
-        }
-        else if (job == JOB_TYPE_MIXED)
+        // keep two chunks in flight while there is work to claim
+        while (num_active < 2)
         {
-            for (int i = 0; i < num_sample; i++)
-            {
-                float curr = data_input[i];
-                data_result[i] = std::tan(curr) + std::tan(2.0*curr) + std::sin(curr*curr) + std::cos(curr+0.5);
-            }
+            CoExecSlot& slot = slots[(cur + num_active) % 2];
+            size_t chunk = coexec_chunk_size(st, st.device_rate.load(), coexec_total_rate(st), min_chunk, max_chunk);
+            if (!coexec_claim(st, chunk, slot.begin, slot.end)) break;
+            coexec_enqueue(slot);
+            num_active++;
         }
-        else
+        if (!num_active) break;
+
+        CoExecSlot& slot = slots[cur];
+        cl_int err = clWaitForEvents(1, &slot.ev_read);
+        if (err != CL_SUCCESS)
         {
-            abort();
+            std::fprintf(stderr, "failed to wait for co-execution chunk: %d\n", err);
+            std::exit(1);
         }
+        clReleaseEvent(slot.ev_read);
+        slot.ev_read = nullptr;
+
+        // completions are back to back while two chunks are queued
+        double t_now = now_us();
+        update_rate(st.device_rate, double(slot.end - slot.begin), t_now - t_last);
+        t_last = t_now;
+        st.device_chunks++;
+        st.device_samples += slot.end - slot.begin;
+
+        cur = (cur + 1) % 2;
+        num_active--;
     }
-    else
+}
+
+void run_co_exec()
+{
+    // the main thread drives the device, so leave it one hardware thread
+    size_t num_host_threads = host_threads;
+    if (!num_host_threads)
+        num_host_threads = std::max(size_t(1), HostThreadPool::get_hardware_threads() - 1);
+    HostThreadPool pool(num_host_threads, pin_threads);
+
+    // device chunks are at least one full launch, and bounded by the staging buffers
+    size_t device_max_chunk = std::min(size_t(num_sample), size_t(1) << 22);
+    size_t device_min_chunk = std::min(device_max_chunk, std::max(global_size, size_t(host_chunk)));
+
+    CoExecSlot slots[2];
+    for (int i = 0; i < 2; i++)
     {
-        cl_int err = 0;
+        slots[i].buf_input = acquire_buffer(CL_MEM_READ_ONLY, device_max_chunk * sizeof(float), "co-execution input");
+        slots[i].buf_result = acquire_buffer(CL_MEM_WRITE_ONLY, device_max_chunk * sizeof(float), "co-execution result");
+    }
 
-        int chunk_size = -1;
-        {
-            int rem = num_sample % dim1_size;
-            chunk_size = (num_sample - rem) / dim1_size;
-            if (rem) chunk_size += 1;
-        }
-        //    printf("%d samples, each chunk %d\n", num_sample, chunk_size);
+    if (zero_copy_result_mapped)
+        unmap_zero_copy_result();
 
-        if (mode == BUFFER_MODE_HOST_MAP)
-        {
-            err = clSetKernelArg(kern, 0, sizeof(cl_mem), &buf_input_host);
-            if (err != CL_SUCCESS)
-            {
-                printf("failed to set arg0 using host-side input buffer %p: %d\n", buf_input_host, err);
-                exit(1);
-            }
+    CoExecState st;
+    st.n = num_sample;
+    st.num_host_threads = pool.get_num_threads();
+    st.host_rate = 0.0;
+    st.device_rate = 0.0;
 
-            err = clSetKernelArg(kern, 1, sizeof(cl_mem), &buf_result_host);
-            if (err != CL_SUCCESS)
-            {
-                printf("failed to set arg0 using host-side result buffer %p\n: %d", buf_result_host, err);
-                exit(1);
-            }
-        }
-        else if (mode == BUFFER_MODE_DEVICE_MAP || mode == BUFFER_MODE_PINNED)
-        {
-            err = clSetKernelArg(kern, 0, sizeof(cl_mem), &buf_input_dev);
-            if (err != CL_SUCCESS)
-            {
-                printf("failed to set arg0 using device-side input buffer %p\n: %d", buf_input_dev, err);
-                exit(1);
-            }
+    printf("run %d times with %lu host threads beside the device\n", num_iter, (unsigned long) st.num_host_threads);
+    LatencyRecorder time_pass;
+    LatencyRecorder time_gap;
+    time_pass.reserve(num_iter);
+    time_gap.reserve(num_iter);
+    double host_share_sum = 0.0;
 
-            err = clSetKernelArg(kern, 1, sizeof(cl_mem), &buf_result_dev);
-            if (err != CL_SUCCESS)
-            {
-                printf("failed to set arg0 using device-side result buffer %p\n: %d", buf_result_dev, err);
-                exit(1);
-            }
-        }
+    // rates carry over between iterations, so later ones start with balanced chunks
+    for (int cycle = 0; cycle < num_iter; cycle++)
+    {
+        st.next = 0;
+        st.host_samples = 0;
+        st.host_chunks = 0;
+        st.device_samples = 0;
+        st.device_chunks = 0;
+
+        double t0 = now_us();
+        double t_host_done = t0;
+        std::thread host_side([&]() {
+            pool.parallel_for(st.num_host_threads, 1, [&](size_t, size_t) {
+                coexec_host_worker(st);
+            });
+            t_host_done = now_us();
+        });
+        coexec_device_driver(st, slots, device_min_chunk, device_max_chunk);
+        double t_device_done = now_us();
+        host_side.join();
+        time_pass.add(now_us() - t0);
+        time_gap.add(std::abs(t_device_done - t_host_done));
+        host_share_sum += double(st.host_samples) / num_sample;
 
-        clSetKernelArg(kern, 2, sizeof(num_sample), &num_sample);
-        clSetKernelArg(kern, 3, sizeof(chunk_size), &chunk_size);
+        if (do_validate)
+            validate_result();
 
-        clEnqueueNDRangeKernel(cmd_queue, kern,
-                               1,
-                               nullptr, &dim1_size,
-                               nullptr,
-                               0, nullptr, nullptr);
-        clFinish(cmd_queue);
+        for (int64_t i = 0; i < num_sample; i++)
+            data_result[i] = 0.0f;
+    }
+
+    double samples_per_sec = double(num_sample) * num_iter / time_pass.total() * 1e6;
+    double serial_samples_per_sec = double(num_sample) * num_iter / time_iter.total() * 1e6;
+
+    BenchReport report;
+    set_common_attrs(report);
+    report.set_attr("exec", "co_exec");
+    report.set_attr("host_threads", htio2::to_string(st.num_host_threads));
+    report.add_phase("iteration", time_pass.summarize());
+    report.add_phase("finish_gap", time_gap.summarize());
+    report.add_metric("samples_per_sec", samples_per_sec);
+    report.add_metric("serial_samples_per_sec", serial_samples_per_sec);
+    report.add_metric("speedup_vs_serial", samples_per_sec / serial_samples_per_sec);
+    report.add_metric("host_share", host_share_sum / num_iter);
+    report.add_metric("host_chunks_last", double(st.host_chunks.load()));
+    report.add_metric("device_chunks_last", double(st.device_chunks));
+    report.add_metric("host_thread_samples_per_sec", st.host_rate.load() * 1e6);
+    report.add_metric("device_samples_per_sec", st.device_rate.load() * 1e6);
+    add_validation(report);
+    reports.push_back(report);
+
+    for (int i = 0; i < 2; i++)
+    {
+        buffer_pool->release(slots[i].buf_input);
+        buffer_pool->release(slots[i].buf_result);
     }
 }
 
-void fetch_result()
+//
+// storage types
+// The same serial run with device buffers of another element type. Buffer
+// size, kernel source, host conversion and validation all follow from the
+// StorageTraits of the type, so fp16 reads and writes through
+// vload_half/vstore_half and fp64 calculates in double. Host arrays stay
+// float, the conversion happens where the fp32 path copies into and out of
+// the mapped or staging buffers. The launch configuration of the fp32 run is
+// kept so only the storage differs, and the fp32 buffers and kernel are
+// brought back afterwards for the runs that follow.
+//
+void switch_storage(StorageType type)
 {
-    if (mode == BUFFER_MODE_DUMMY) return;
+    size_t saved_global = global_size;
+    size_t saved_local = local_size;
+
+    release_buffer_object();
+    clReleaseKernel(kern);
+    clReleaseProgram(prog);
+
+    storage = type;
+    create_buffer_object();
+    create_program_kernel();
+    global_size = saved_global;
+    local_size = saved_local;
+}
+
+void run_storage(StorageType type, double fp32_iter_us)
+{
+    if (type == STORAGE_FP64 && get_dev_info_string(dev, CL_DEVICE_EXTENSIONS).find("cl_khr_fp64") == std::string::npos)
+    {
+        printf("\ndevice has no cl_khr_fp64, skip fp64 run\n");
+        return;
+    }
+
+    printf("\nrun with %s storage\n", htio2::to_string(type).c_str());
+    switch_storage(type);
 
+    run_serial();
+
+    BenchReport& report = reports.back();
+    if (type == STORAGE_FP16)
+        report.set_attr("host_convert", host_has_f16c() ? "f16c" : "scalar");
+    report.add_metric("fp32_iteration_us", fp32_iter_us);
+    report.add_metric("speedup_vs_fp32", fp32_iter_us / (time_iter.total() / num_iter));
+
+    switch_storage(STORAGE_FP32);
+}
+
+//
+// fused jobs
+// The three job formulas all start from sin/tan/cos of x, 2*x, x*x and x+0.5.
+// Run one by one, each job uploads the same input, recalculates those
+// subexpressions and downloads its result. The fused kernel merges the
+// formulas with FusedExpr, so it reads each sample once, calculates every
+// shared operation once, and writes one result stream per job. Both sides go
+// through the pinned staging path of the serial run, with one device and one
+// staging buffer per result.
+//
+const JobType fused_jobs[] = {JOB_TYPE_MIXED, JOB_TYPE_SINE, JOB_TYPE_TANGENT};
+const size_t num_fused_job = sizeof(fused_jobs) / sizeof(fused_jobs[0]);
+
+cl_kernel create_named_kernel(cl_program program, const std::string& name)
+{
     cl_int err = 0;
+    cl_kernel re = clCreateKernel(program, name.c_str(), &err);
+    if (err != CL_SUCCESS)
+    {
+        printf("failed to create kernel %s with error: %d\n", name.c_str(), err);
+        exit(1);
+    }
+    return re;
+}
 
-    if (mode == BUFFER_MODE_HOST_MAP)
+void check_fused_transfer(cl_int err)
+{
+    if (err != CL_SUCCESS)
     {
-        pinned_result = clEnqueueMapBuffer(cmd_queue, buf_result_host, true, CL_MAP_READ,
-                                           0, sizeof(float) * num_sample,
-                                           0, nullptr, nullptr,
-                                           &err);
-        if (err != CL_SUCCESS)
-        {
-            std::fprintf(stderr, "failed to map host-side result buffer: %d\n", err);
-            exit(1);
-        }
+        printf("failed to enqueue fused run transfer: %d\n", err);
+        exit(1);
+    }
+}
 
-        memcpy(data_result, pinned_result, num_sample * sizeof(float));
+// the tuned work-group size if kernel k can take it, otherwise 0 to leave
+// it to the driver; the fused kernel holds more live values and may not
+size_t get_fused_local_size(cl_kernel k)
+{
+    size_t max_local = 0;
+    cl_int err = clGetKernelWorkGroupInfo(k, dev, CL_KERNEL_WORK_GROUP_SIZE, sizeof(max_local), &max_local, nullptr);
+    if (err != CL_SUCCESS)
+    {
+        printf("failed to get work-group size of fused run kernel: %d\n", err);
+        exit(1);
+    }
+    return local_size <= max_local ? local_size : 0;
+}
 
-        err = clEnqueueUnmapMemObject(cmd_queue, buf_result_host, pinned_result,
-                                      0, nullptr, nullptr);
-        if (err != CL_SUCCESS)
-        {
-            std::fprintf(stderr, "failed to unmap host-side result buffer: %d\n", err);
-            exit(1);
-        }
+void enqueue_fused_kernel(cl_kernel k, const size_t& local)
+{
+    cl_int err = clEnqueueNDRangeKernel(cmd_queue, k, 1, nullptr, &global_size,
+                                        local ? &local : nullptr,
+                                        0, nullptr, nullptr);
+    if (err != CL_SUCCESS)
+    {
+        printf("failed to enqueue fused run kernel: %d\n", err);
+        exit(1);
     }
-    else if (mode == BUFFER_MODE_DEVICE_MAP)
+}
+
+void run_fused()
+{
+    size_t bytes = sizeof(float) * num_sample;
+
+    Expr job_formulas[num_fused_job];
+    FusedExpr merged;
+    std::string src;
+    std::string texts;
+    std::string hashes;
+    for (size_t i = 0; i < num_fused_job; i++)
     {
-        pinned_result = clEnqueueMapBuffer(cmd_queue, buf_result_dev, true, CL_MAP_READ,
-                                           0, sizeof(float) * num_sample,
-                                           0, nullptr, nullptr,
-                                           &err);
-        if (err != CL_SUCCESS)
+        std::string error;
+        if (!job_formulas[i].parse(job_expression(fused_jobs[i]), error))
+            abort();
+        merged.add(job_formulas[i]);
+        src += make_kernel_source(job_formulas[i].to_opencl(), kernel_layout, "job_" + htio2::to_string(fused_jobs[i]));
+        texts += (i ? "; " : "") + job_formulas[i].get_text();
+        hashes += (i ? "; " : "") + job_formulas[i].get_hash();
+    }
+    src += make_fused_kernel_source(merged, kernel_layout, "fused");
+
+    bool cache_hit = false;
+    cl_program fused_prog = build_program_cached(context, dev, src, "", binary_cache_dir, cache_hit);
+    cl_kernel job_kernels[num_fused_job];
+    for (size_t i = 0; i < num_fused_job; i++)
+        job_kernels[i] = create_named_kernel(fused_prog, "job_" + htio2::to_string(fused_jobs[i]));
+    cl_kernel fused_kernel = create_named_kernel(fused_prog, "fused");
+
+    // launch limits are queried once, out of the timed loops
+    size_t job_locals[num_fused_job];
+    std::string job_local_texts;
+    for (size_t i = 0; i < num_fused_job; i++)
+    {
+        job_locals[i] = get_fused_local_size(job_kernels[i]);
+        job_local_texts += (i ? "; " : "") + htio2::to_string(job_locals[i]);
+    }
+    size_t fused_local = get_fused_local_size(fused_kernel);
+    if (fused_local != local_size)
+        printf("fused kernel can not take local size %lu, leave it to the driver\n", (unsigned long) local_size);
+
+    cl_mem buf_outputs[num_fused_job];
+    cl_mem buf_stagings[num_fused_job];
+    float* stagings[num_fused_job];
+    std::vector<float> results[num_fused_job];
+    int64_t chunk_size = calc_chunk_size();
+    for (size_t i = 0; i < num_fused_job; i++)
+    {
+        buf_outputs[i] = create_pipeline_buffer(CL_MEM_WRITE_ONLY, num_sample, "fused result");
+        buf_stagings[i] = create_pipeline_buffer(CL_MEM_ALLOC_HOST_PTR, num_sample, "fused staging");
+        stagings[i] = map_pipeline_buffer(buf_stagings[i], CL_MAP_READ, num_sample, "fused staging");
+        results[i].resize(num_sample);
+
+        clSetKernelArg(job_kernels[i], 0, sizeof(cl_mem), &buf_input_dev);
+        clSetKernelArg(job_kernels[i], 1, sizeof(cl_mem), &buf_outputs[i]);
+        set_range_args(job_kernels[i], num_sample, chunk_size);
+    }
+    clSetKernelArg(fused_kernel, 0, sizeof(cl_mem), &buf_input_dev);
+    clSetKernelArg(fused_kernel, 1, sizeof(cl_mem), &buf_outputs[0]);
+    set_range_args(fused_kernel, num_sample, chunk_size);
+    for (cl_uint i = 1; i < num_fused_job; i++)
+        clSetKernelArg(fused_kernel, 3 + i, sizeof(cl_mem), &buf_outputs[i]);
+
+    printf("run %d times with %lu jobs one by one and fused, %lu operations fused from %lu\n",
+           num_iter, (unsigned long) num_fused_job,
+           (unsigned long) merged.get_num_op(), (unsigned long) merged.get_num_op_separate());
+
+    LatencyRecorder time_separate;
+    LatencyRecorder time_fused;
+    time_separate.reserve(num_iter);
+    time_fused.reserve(num_iter);
+
+    for (int cycle = 0; cycle < num_iter; cycle++)
+    {
+        // one by one: every job uploads its input and downloads its result
+        double t0 = now_us();
+        for (size_t i = 0; i < num_fused_job; i++)
         {
-            std::fprintf(stderr, "failed to map device-side result buffer: %d\n", err);
-            exit(1);
+            memcpy(pinned_input, data_input, bytes);
+            check_fused_transfer(clEnqueueWriteBuffer(cmd_queue, buf_input_dev, false, 0, bytes, pinned_input,
+                                                      0, nullptr, nullptr));
+            enqueue_fused_kernel(job_kernels[i], job_locals[i]);
+            check_fused_transfer(clEnqueueReadBuffer(cmd_queue, buf_outputs[i], true, 0, bytes, stagings[i],
+                                                     0, nullptr, nullptr));
+            memcpy(results[i].data(), stagings[i], bytes);
         }
+        double t1 = now_us();
+
+        // fused: one upload, one kernel, all results downloaded behind it
+        memcpy(pinned_input, data_input, bytes);
+        check_fused_transfer(clEnqueueWriteBuffer(cmd_queue, buf_input_dev, false, 0, bytes, pinned_input,
+                                                  0, nullptr, nullptr));
+        enqueue_fused_kernel(fused_kernel, fused_local);
+        for (size_t i = 0; i < num_fused_job; i++)
+            check_fused_transfer(clEnqueueReadBuffer(cmd_queue, buf_outputs[i], false, 0, bytes, stagings[i],
+                                                     0, nullptr, nullptr));
+        clFinish(cmd_queue);
+        for (size_t i = 0; i < num_fused_job; i++)
+            memcpy(results[i].data(), stagings[i], bytes);
+        double t2 = now_us();
 
-        memcpy(data_result, pinned_result, num_sample * sizeof(float));
+        time_separate.add(t1 - t0);
+        time_fused.add(t2 - t1);
 
-        err = clEnqueueUnmapMemObject(cmd_queue, buf_result_dev, pinned_result,
-                                      0, nullptr, nullptr);
-        if (err != CL_SUCCESS)
+        if (do_validate)
         {
-            std::fprintf(stderr, "failed to unmap device-side result buffer: %d\n", err);
-            exit(1);
+            for (size_t i = 0; i < num_fused_job; i++)
+                validate_results(job_formulas[i], data_input, results[i].data(), num_sample,
+                                 validate_pool, validate_sample, validate_seed++, validate_stats);
         }
     }
-    else if (mode == BUFFER_MODE_PINNED)
+
+    // per iteration, one by one moves input and result of every job, fused
+    // moves the input once and every result
+    double bytes_separate = double(bytes) * 2 * num_fused_job;
+    double bytes_fused = double(bytes) * (1 + num_fused_job);
+
+    BenchReport report;
+    set_common_attrs(report);
+    report.set_attr("exec", "fused");
+    report.set_attr("job", "fused");
+    report.set_attr("formula", texts);
+    report.set_attr("formula_hash", hashes);
+    report.set_attr("separate_local_size", job_local_texts);
+    report.set_attr("fused_local_size", htio2::to_string(fused_local));
+    report.add_phase("separate_iteration", time_separate.summarize());
+    report.add_phase("fused_iteration", time_fused.summarize());
+    report.add_metric("ops_separate", double(merged.get_num_op_separate()));
+    report.add_metric("ops_fused", double(merged.get_num_op()));
+    report.add_metric("bytes_separate", bytes_separate);
+    report.add_metric("bytes_fused", bytes_fused);
+    report.add_metric("bytes_saved", bytes_separate - bytes_fused);
+    report.add_metric("separate_gb_per_sec", bytes_separate * num_iter / time_separate.total() / 1e3);
+    report.add_metric("fused_gb_per_sec", bytes_fused * num_iter / time_fused.total() / 1e3);
+    report.add_metric("speedup_vs_separate", time_separate.total() / time_fused.total());
+    add_validation(report);
+    reports.push_back(report);
+
+    for (size_t i = 0; i < num_fused_job; i++)
     {
-        err = clEnqueueReadBuffer(cmd_queue, buf_result_dev, true,
-                                  0, sizeof(float) * num_sample, pinned_result,
-                                  0, nullptr, nullptr);
-        if (err != CL_SUCCESS)
+        clEnqueueUnmapMemObject(cmd_queue, buf_stagings[i], stagings[i], 0, nullptr, nullptr);
+        buffer_pool->release(buf_outputs[i]);
+        clReleaseKernel(job_kernels[i]);
+    }
+    clFinish(cmd_queue);
+    for (size_t i = 0; i < num_fused_job; i++)
+        buffer_pool->release(buf_stagings[i]);
+    clReleaseKernel(fused_kernel);
+    clReleaseProgram(fused_prog);
+}
+
+//
+// NUMA placement
+// Bandwidth of the copies the driving thread does into staging memory, for
+// the thread on the CPUs of each node reading memory bound to each node, then
+// for the host input array as placed by --numa. In pinned mode the copies go
+// into the pinned staging buffer like send_input() does, wherever the driver
+// put it; otherwise into the host result array.
+//
+double time_memcpy(void* dst, const void* src, size_t bytes, LatencyRecorder& time_copy)
+{
+    memcpy(dst, src, bytes); // warm-up, and faults in what is not yet
+    time_copy.clear();
+    time_copy.reserve(num_iter);
+    for (int cycle = 0; cycle < num_iter; cycle++)
+    {
+        double t0 = now_us();
+        memcpy(dst, src, bytes);
+        time_copy.add(now_us() - t0);
+    }
+    // bytes per us / 1e3 = GB/s
+    return double(bytes) * num_iter / time_copy.total() / 1e3;
+}
+
+void run_numa_placement()
+{
+    size_t bytes = sizeof(float) * num_sample;
+    bool to_staging = mode == BUFFER_MODE_PINNED && pinned_input;
+    void* dst = to_staging ? pinned_input : (void*) data_result;
+    int num_nodes = get_num_numa_nodes();
+
+    BenchReport report;
+    set_common_attrs(report);
+    report.set_attr("exec", "numa");
+    report.set_attr("numa_policy", htio2::to_string(numa_policy));
+    report.set_attr("numa_node", htio2::to_string(numa_node));
+    report.set_attr("numa_node_source", numa_node_source);
+    report.set_attr("numa_nodes", htio2::to_string(num_nodes));
+    report.set_attr("device_pci", dev_pci_address.length() ? dev_pci_address : "unknown");
+    report.set_attr("memcpy_dst", to_staging ? "pinned_staging" : "host_array");
+    report.set_attr("input_page_node", htio2::to_string(get_page_numa_node(data_input)));
+    report.set_attr("dst_page_node", htio2::to_string(get_page_numa_node(dst)));
+
+    LatencyRecorder time_copy;
+    printf("memcpy %lu bytes %d times for each placement\n", (unsigned long) bytes, num_iter);
+    for (int cpu_node = 0; cpu_node < num_nodes; cpu_node++)
+    {
+        std::string error;
+        if (!pin_thread_to_numa_node(cpu_node, error))
         {
-            std::fprintf(stderr, "failed to read device-side result buffer: %d\n");
-            exit(1);
+            printf("skip CPUs of node %d: %s\n", cpu_node, error.c_str());
+            continue;
         }
 
-        memcpy(data_result, pinned_result, sizeof(float) * num_sample);
+        for (int mem_node = 0; mem_node < num_nodes; mem_node++)
+        {
+            size_t src_size = (bytes + 4095) / 4096 * 4096;
+            void* src = aligned_host_alloc(4096, src_size);
+            if (!src || !bind_numa_memory(src, src_size, mem_node, error))
+            {
+                printf("skip memory of node %d: %s\n", mem_node, error.c_str());
+                aligned_host_free(src);
+                continue;
+            }
+            memset(src, 0, src_size);
+
+            std::string name = "memcpy.cpu" + htio2::to_string(cpu_node) + ".mem" + htio2::to_string(mem_node);
+            double gb_per_sec = time_memcpy(dst, src, bytes, time_copy);
+            report.add_phase(name, time_copy.summarize());
+            report.add_metric(name + ".gb_per_sec", gb_per_sec);
+            aligned_host_free(src);
+        }
     }
-    else
+
+    // back on the chosen node for the copy of the real input and the runs after
+    std::string error;
+    if (!pin_thread_to_numa_node(numa_node, error))
     {
-        abort();
+        std::fprintf(stderr, "failed to pin driving thread back to NUMA node %d: %s\n", numa_node, error.c_str());
+        std::exit(1);
     }
+    double gb_per_sec = time_memcpy(dst, data_input, bytes, time_copy);
+    report.add_phase("memcpy.input", time_copy.summarize());
+    report.add_metric("memcpy.input.gb_per_sec", gb_per_sec);
+    reports.push_back(report);
 }
 
-void validate_result()
+//
+// parameter sweep
+// The kernels of all job types are built into one program up front, and
+// every point shares the context and queue. A point only recreates the
+// buffers of its mode and size, then goes through the serial run, so each
+// (num_sample, mode, job) adds one report.
+//
+const BufferMode sweep_modes[] = {
+    BUFFER_MODE_DUMMY, BUFFER_MODE_HOST_MAP, BUFFER_MODE_DEVICE_MAP, BUFFER_MODE_PINNED, BUFFER_MODE_ZERO_COPY
+};
+const JobType sweep_jobs[] = {JOB_TYPE_MIXED, JOB_TYPE_SINE, JOB_TYPE_TANGENT};
+const size_t num_sweep_mode = sizeof(sweep_modes) / sizeof(sweep_modes[0]);
+const size_t num_sweep_job = sizeof(sweep_jobs) / sizeof(sweep_jobs[0]);
+
+cl_kernel sweep_kernels[num_sweep_job];
+
+std::string sweep_kernel_name(JobType job_type)
 {
-    for (int i = 0; i < num_sample; i++)
+    return "job_" + htio2::to_string(job_type);
+}
+
+void create_sweep_program()
+{
+    printf("create and build program of all jobs\n");
+    double t0 = now_us();
+
+    kernel_src.clear();
+    for (size_t i_job = 0; i_job < num_sweep_job; i_job++)
     {
-        float tmp = data_input[i];
-        float expect = 0;
+        Expr job_formula;
+        std::string error;
+        if (!job_formula.parse(job_expression(sweep_jobs[i_job]), error))
+            abort();
+        kernel_src += make_kernel_source(job_formula.to_opencl(), kernel_layout, sweep_kernel_name(sweep_jobs[i_job]));
+    }
 
-        switch(job)
+    bool cache_hit = false;
+    prog = build_program_cached(context, dev, kernel_src, "", binary_cache_dir, cache_hit);
+    if (binary_cache_dir.length())
+        program_cache_state = cache_hit ? "hit" : "miss";
+
+    for (size_t i_job = 0; i_job < num_sweep_job; i_job++)
+    {
+        cl_int err = 0;
+        std::string name = sweep_kernel_name(sweep_jobs[i_job]);
+        sweep_kernels[i_job] = clCreateKernel(prog, name.c_str(), &err);
+        if (err != CL_SUCCESS)
         {
-        case JOB_TYPE_SINE:
-            expect = std::sin(tmp) + std::sin(tmp*2.0) + std::sin(tmp*tmp) + std::sin(tmp+0.5);
-            break;
-        case JOB_TYPE_TANGENT:
-            expect = std::tan(tmp) + std::tan(tmp*2.0) + std::tan(tmp*tmp) + std::tan(tmp+0.5);
-            break;
-        case JOB_TYPE_MIXED:
-            expect = std::tan(tmp) + std::tan(tmp*2.0) + std::sin(tmp*tmp) + std::cos(tmp+0.5);
-            break;
-        default:
-            abort();
+            printf("failed to create kernel %s with error: %d\n", name.c_str(), err);
+            exit(1);
         }
+    }
+
+    time_program = now_us() - t0;
+    printf("program ready in %.3f ms, binary cache %s\n", time_program / 1000.0, program_cache_state.c_str());
+}
 
-        if (abs(data_result[i] - expect) > abs(expect) / 10000)
+void run_sweep()
+{
+    for (int64_t n = sweep_min; n <= sweep_max; n *= sweep_factor)
+    {
+        num_sample = n;
+        for (size_t i_mode = 0; i_mode < num_sweep_mode; i_mode++)
         {
-            fprintf(stderr, "result data at %d is %f, expect to be %f\n", i, data_result[i], expect);
-            abort();
+            mode = sweep_modes[i_mode];
+            create_buffer_object();
+
+            for (size_t i_job = 0; i_job < num_sweep_job; i_job++)
+            {
+                job = sweep_jobs[i_job];
+                std::string error;
+                if (!formula.parse(job_expression(job), error))
+                    abort();
+
+                printf("\nsweep: %lld samples, %s, %s\n", (long long) num_sample,
+                       htio2::to_string(mode).c_str(), htio2::to_string(job).c_str());
+                if (mode == BUFFER_MODE_DUMMY)
+                {
+                    global_size = 0;
+                    local_size = 0;
+                }
+                else
+                {
+                    kern = sweep_kernels[i_job];
+                    setup_launch();
+                }
+                run_serial();
+            }
+
+            release_buffer_object();
         }
+
+        // the next point needs larger size classes, so nothing pooled now is reused
+        if (buffer_pool) buffer_pool->trim();
+
+        if (n > sweep_max / sweep_factor) break;
     }
+
+    for (size_t i_job = 0; i_job < num_sweep_job; i_job++)
+    {
+        clReleaseKernel(sweep_kernels[i_job]);
+        sweep_kernels[i_job] = nullptr;
+    }
+    kern = nullptr;
+    clReleaseProgram(prog);
+    prog = nullptr;
 }
 
 int main(int argc, char** argv)
 {
+    double time_main_begin = now_us();
     parse_arg(argc, argv);
 
     cl_uint num_dim = 0;
@@ -630,40 +3560,130 @@ int main(int argc, char** argv)
         dim1_size = dim_sizes[0];
     }
 
+    if (mode == BUFFER_MODE_DUMMY || sweep_max)
+        host_pool = new HostThreadPool(host_threads, pin_threads);
+    else if (do_validate)
+        validate_pool = new HostThreadPool(host_threads, pin_threads);
+
+    // open counters once the host threads exist, and before the context,
+    // which may start threads of the OpenCL runtime
+    if (do_perf)
+    {
+        perf_counters = new PerfCounters;
+        std::string error;
+        if (!perf_counters->open(error))
+        {
+            fprintf(stderr, "failed to open perf counters: %s\n", error.c_str());
+            exit(1);
+        }
+        printf("perf counters: %s, %s\n", perf_counters->get_available_names().c_str(),
+               perf_counters->is_kernel_counted() ? "user and kernel" : "user only");
+    }
+
+    // pin after the pools start, so their workers keep all CPUs, and before
+    // the host arrays are placed
+    setup_numa();
+
+    // initialize input data
+    // zero-copy buffers take their content from the host arrays, so fill them first
+    // with device input the host copy is only the reference for validation
+    alloc_host_arrays();
+    generate_input(input_dist, input_seed, 0, data_input, num_sample);
+
     create_context();
     create_cmd_queue();
-    create_buffer_object();
-    create_program_kernel();
+    if (sweep_max)
+    {
+        // buffers are created for each point of the sweep
+        create_sweep_program();
+    }
+    else
+    {
+        if (!stream_tile)
+            create_buffer_object(); // streaming has its own ring of tile buffers
+        create_program_kernel();
+    }
 
-    // initialize input data
-    data_input = (float*) malloc(num_sample * sizeof(float));
-    data_result = (float*) malloc(num_sample * sizeof(float));
-    for (int i = 0; i < num_sample; i++)
-        data_input[i] = i;
+    // startup excludes tuning sweeps
+    time_startup = now_us() - time_main_begin;
+
+    if (do_autotune)
+        autotune_launch();
 
     // run
-    printf("run %d times\n", num_iter);
-    for (int cycle = 0; cycle < num_iter; cycle++)
+    if (sweep_max)
+        run_sweep();
+    else if (stream_tile)
+        run_streaming();
+    else
+        run_serial();
+
+    if (numa_policy != NUMA_POLICY_NONE)
+        run_numa_placement();
+
+    if (pipeline_depth > 1)
+        run_pipelined();
+
+    if (async_depth)
+        run_async();
+
+    if (replay)
+        run_replay();
+
+    if (batch_size)
+        run_batched();
+
+    if (host_scaling)
+        run_host_scaling();
+
+    if (co_exec)
+        run_co_exec();
+
+    if (fused)
+        run_fused();
+
+    if (compare_storage.size())
     {
-        send_input();
-        run();
-        fetch_result();
+        double fp32_iter_us = time_iter.total() / num_iter;
+        for (size_t i = 0; i < compare_storage.size(); i++)
+            run_storage(compare_storage[i], fp32_iter_us);
+    }
 
-        // validate result
-        if (do_validate)
-        {
-            validate_result();
-        }
+    if (multi_device)
+        run_multi_device();
 
-        // clear store
-        for (int i = 0; i < num_sample; i++)
-        {
-            data_result[i] = 0.0f;
-        }
+    release_buffer_object();
+    if (buffer_pool)
+    {
+        buffer_pool->trim();
+
+        BenchReport report;
+        set_common_attrs(report);
+        report.set_attr("exec", "buffer_pool");
+        report.set_attr("pooling", no_buffer_pool ? "off" : "on");
+        buffer_pool->add_to_report(report);
+        reports.push_back(report);
+    }
+
+    for (size_t i = 0; i < reports.size(); i++)
+    {
+        printf("\n");
+        print_report(reports[i]);
+    }
+
+    if (result_file.length())
+    {
+        if (!write_reports(result_file, result_format, reports))
+            exit(1);
     }
 
     printf("finalize\n");
-    free(data_input);
-    free(data_result);
+    delete buffer_pool;
+
+    aligned_host_free(data_input);
+    aligned_host_free(data_result);
+    delete host_pool;
+    delete validate_pool;
+    delete perf_counters;
 }
 
@@ -0,0 +1,169 @@
+#include "buffer_pool.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+static const size_t MIN_SIZE_CLASS = 4096;
+
+size_t BufferPool::get_size_class(size_t size, size_t max_size)
+{
+    size_t re = MIN_SIZE_CLASS;
+    while (re < size) re *= 2;
+    if (re > max_size && size <= max_size) return size;
+    return re;
+}
+
+BufferPool::BufferPool(cl_context context, bool enabled)
+    : context(context)
+    , enabled(enabled)
+{
+    max_alloc_size = ~size_t(0);
+
+    size_t devices_bytes = 0;
+    cl_int err = clGetContextInfo(context, CL_CONTEXT_DEVICES, 0, nullptr, &devices_bytes);
+    std::vector<cl_device_id> devices(devices_bytes / sizeof(cl_device_id));
+    if (err == CL_SUCCESS && devices.size())
+        err = clGetContextInfo(context, CL_CONTEXT_DEVICES, devices_bytes, &devices[0], nullptr);
+    if (err != CL_SUCCESS)
+    {
+        fprintf(stderr, "failed to get devices of buffer pool context: %d\n", err);
+        exit(1);
+    }
+
+    for (size_t i = 0; i < devices.size(); i++)
+    {
+        cl_ulong limit = 0;
+        err = clGetDeviceInfo(devices[i], CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(limit), &limit, nullptr);
+        if (err == CL_SUCCESS && limit && limit < max_alloc_size)
+            max_alloc_size = size_t(limit);
+    }
+}
+
+BufferPool::~BufferPool()
+{
+    trim();
+    if (in_use.size())
+        fprintf(stderr, "buffer pool destroyed with %lu buffers still in use\n", (unsigned long) in_use.size());
+}
+
+cl_mem BufferPool::acquire(cl_mem_flags flags, size_t size, cl_int& err)
+{
+    if (flags & (CL_MEM_USE_HOST_PTR | CL_MEM_COPY_HOST_PTR))
+    {
+        fprintf(stderr, "buffer pool can not hold buffers of host memory\n");
+        abort();
+    }
+
+    Key key(flags, get_size_class(size, max_alloc_size));
+    num_acquire++;
+    bytes_requested += size;
+    err = CL_SUCCESS;
+
+    cl_mem re = nullptr;
+    std::vector<cl_mem>& free_list = free_lists[key];
+    if (free_list.size())
+    {
+        re = free_list.back();
+        free_list.pop_back();
+        bytes_free -= key.second;
+        num_reuse++;
+    }
+    else
+    {
+        double t0 = now_us();
+        re = clCreateBuffer(context, flags, key.second, nullptr, &err);
+        if (err != CL_SUCCESS) return nullptr;
+        time_create[key.second].add(now_us() - t0);
+        num_create++;
+    }
+
+    in_use[re] = key;
+    bytes_in_use += key.second;
+    if (bytes_in_use + bytes_free > bytes_peak)
+        bytes_peak = bytes_in_use + bytes_free;
+    return re;
+}
+
+void BufferPool::release(cl_mem buffer)
+{
+    std::map<cl_mem, Key>::iterator it = in_use.find(buffer);
+    if (it == in_use.end())
+    {
+        fprintf(stderr, "buffer %p is not from the pool\n", buffer);
+        abort();
+    }
+
+    Key key = it->second;
+    in_use.erase(it);
+    bytes_in_use -= key.second;
+
+    if (enabled)
+    {
+        free_lists[key].push_back(buffer);
+        bytes_free += key.second;
+    }
+    else
+    {
+        destroy(buffer, key.second);
+    }
+}
+
+void BufferPool::destroy(cl_mem buffer, size_t size_class)
+{
+    double t0 = now_us();
+    clReleaseMemObject(buffer);
+    time_destroy[size_class].add(now_us() - t0);
+    num_destroy++;
+}
+
+static bool larger_class_first(const std::pair<cl_mem_flags, size_t>& a, const std::pair<cl_mem_flags, size_t>& b)
+{
+    return a.second > b.second;
+}
+
+void BufferPool::trim(size_t keep_bytes)
+{
+    std::vector<Key> keys;
+    for (std::map<Key, std::vector<cl_mem> >::iterator it = free_lists.begin(); it != free_lists.end(); ++it)
+        keys.push_back(it->first);
+    std::stable_sort(keys.begin(), keys.end(), larger_class_first);
+
+    for (size_t i = 0; i < keys.size() && bytes_free > keep_bytes; i++)
+    {
+        std::vector<cl_mem>& free_list = free_lists[keys[i]];
+        while (free_list.size() && bytes_free > keep_bytes)
+        {
+            destroy(free_list.back(), keys[i].second);
+            free_list.pop_back();
+            bytes_free -= keys[i].second;
+        }
+    }
+}
+
+void BufferPool::add_to_report(BenchReport& report) const
+{
+    report.add_metric("pool.acquire", double(num_acquire));
+    report.add_metric("pool.reuse", double(num_reuse));
+    report.add_metric("pool.create", double(num_create));
+    report.add_metric("pool.destroy", double(num_destroy));
+    report.add_metric("pool.reuse_rate", num_acquire ? double(num_reuse) / num_acquire : 0.0);
+    report.add_metric("pool.bytes_peak", double(bytes_peak));
+    report.add_metric("pool.bytes_free", double(bytes_free));
+    report.add_metric("pool.bytes_requested", double(bytes_requested));
+
+    double create_us = 0.0;
+    double destroy_us = 0.0;
+    for (std::map<size_t, LatencyRecorder>::const_iterator it = time_create.begin(); it != time_create.end(); ++it)
+    {
+        report.add_phase("create." + htio2::to_string(it->first), it->second.summarize());
+        create_us += it->second.total();
+    }
+    for (std::map<size_t, LatencyRecorder>::const_iterator it = time_destroy.begin(); it != time_destroy.end(); ++it)
+    {
+        report.add_phase("destroy." + htio2::to_string(it->first), it->second.summarize());
+        destroy_us += it->second.total();
+    }
+    report.add_metric("pool.create_us", create_us);
+    report.add_metric("pool.destroy_us", destroy_us);
+}
@@ -0,0 +1,94 @@
+#ifndef MY_BUFFER_POOL_H
+#define MY_BUFFER_POOL_H
+
+#include <CL/cl.h>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "bench_report.h"
+
+///
+/// \brief reuses device buffers of one context instead of creating and
+/// releasing them for every run
+///
+/// Sizes are rounded up to a power of two of at least 4 KiB, and released
+/// buffers are kept on a free list per (flags, size class), so a later request
+/// of the same flags and class gets one back without calling clCreateBuffer.
+/// A buffer may therefore be up to twice as large as requested, except where
+/// the class would exceed CL_DEVICE_MAX_MEM_ALLOC_SIZE of a device in the
+/// context: such requests use their exact size as class. Buffers that
+/// wrap host memory (CL_MEM_USE_HOST_PTR, CL_MEM_COPY_HOST_PTR) can not be
+/// pooled and are not accepted.
+///
+/// With pooling disabled, release() destroys the buffer right away, which
+/// gives the allocation cost of the same sequence of requests.
+///
+/// clCreateBuffer is lazy on many drivers, and the device allocation may only
+/// happen at the first command using the buffer, so creation times here are
+/// the host-side cost of the calls.
+///
+class BufferPool
+{
+public:
+    BufferPool(cl_context context, bool enabled);
+    ~BufferPool();
+
+    BufferPool(const BufferPool& other) = delete;
+    BufferPool& operator = (const BufferPool& other) = delete;
+
+    ///
+    /// \brief get a buffer of at least size bytes
+    /// \return nullptr with the error in err if clCreateBuffer failed
+    ///
+    cl_mem acquire(cl_mem_flags flags, size_t size, cl_int& err);
+
+    ///
+    /// \brief hand a buffer from acquire() back to the pool
+    ///
+    void release(cl_mem buffer);
+
+    ///
+    /// \brief destroy free buffers until at most keep_bytes stay pooled,
+    /// largest size classes first
+    ///
+    void trim(size_t keep_bytes = 0);
+
+    ///
+    /// \brief add counts of acquire, reuse, create and destroy, byte totals,
+    /// and phases "create.<class bytes>" and "destroy.<class bytes>" in microseconds
+    ///
+    void add_to_report(BenchReport& report) const;
+
+    ///
+    /// \brief round size up to its pool class, or keep it as is if the class
+    /// would be larger than max_size
+    ///
+    static size_t get_size_class(size_t size, size_t max_size);
+
+protected:
+    typedef std::pair<cl_mem_flags, size_t> Key;
+
+    void destroy(cl_mem buffer, size_t size_class);
+
+    cl_context context;
+    bool enabled;
+    size_t max_alloc_size = 0; // smallest limit of the context's devices
+
+    std::map<Key, std::vector<cl_mem> > free_lists;
+    std::map<cl_mem, Key> in_use;
+
+    size_t num_acquire = 0;
+    size_t num_reuse   = 0;
+    size_t num_create  = 0;
+    size_t num_destroy = 0;
+    size_t bytes_in_use = 0;
+    size_t bytes_free   = 0;
+    size_t bytes_peak   = 0;
+    size_t bytes_requested = 0;
+
+    std::map<size_t, LatencyRecorder> time_create;
+    std::map<size_t, LatencyRecorder> time_destroy;
+};
+
+#endif // MY_BUFFER_POOL_H
@@ -0,0 +1,86 @@
+#include "cl_profile.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+EventProfiler::CommandGaps& EventProfiler::get_gaps(const std::string& command)
+{
+    for (size_t i = 0; i < commands.size(); i++)
+    {
+        if (commands[i].first == command)
+            return commands[i].second;
+    }
+    commands.push_back(std::make_pair(command, CommandGaps()));
+    return commands.back().second;
+}
+
+void EventProfiler::record(const std::string& command, cl_event event)
+{
+    if (!event)
+    {
+        fprintf(stderr, "no event to profile for command %s\n", command.c_str());
+        exit(1);
+    }
+    pending.push_back(std::make_pair(command, event));
+}
+
+void EventProfiler::resolve()
+{
+    for (size_t i = 0; i < pending.size(); i++)
+        resolve_event(pending[i].first, pending[i].second);
+    pending.clear();
+}
+
+void EventProfiler::clear()
+{
+    for (size_t i = 0; i < pending.size(); i++)
+        clReleaseEvent(pending[i].second);
+    pending.clear();
+    commands.clear();
+}
+
+void EventProfiler::resolve_event(const std::string& command, cl_event event)
+{
+    cl_int err = clWaitForEvents(1, &event);
+    if (err != CL_SUCCESS)
+    {
+        fprintf(stderr, "failed to wait for %s event: %d\n", command.c_str(), err);
+        exit(1);
+    }
+
+    const cl_profiling_info keys[4] = {
+        CL_PROFILING_COMMAND_QUEUED,
+        CL_PROFILING_COMMAND_SUBMIT,
+        CL_PROFILING_COMMAND_START,
+        CL_PROFILING_COMMAND_END,
+    };
+    cl_ulong stamps[4] = {0, 0, 0, 0};
+    for (int i = 0; i < 4; i++)
+    {
+        err = clGetEventProfilingInfo(event, keys[i], sizeof(cl_ulong), &stamps[i], nullptr);
+        if (err != CL_SUCCESS)
+        {
+            fprintf(stderr, "failed to get profiling info of %s event: %d\n", command.c_str(), err);
+            exit(1);
+        }
+    }
+    clReleaseEvent(event);
+
+    // timestamps are in nanoseconds
+    CommandGaps& gaps = get_gaps(command);
+    gaps.queued_submit.add(double(stamps[1] - stamps[0]) / 1000.0);
+    gaps.submit_start.add(double(stamps[2] - stamps[1]) / 1000.0);
+    gaps.start_end.add(double(stamps[3] - stamps[2]) / 1000.0);
+}
+
+void EventProfiler::add_to_report(BenchReport& report) const
+{
+    for (size_t i = 0; i < commands.size(); i++)
+    {
+        const std::string& name = commands[i].first;
+        const CommandGaps& gaps = commands[i].second;
+        report.add_phase(name + ".queued_submit", gaps.queued_submit.summarize());
+        report.add_phase(name + ".submit_start", gaps.submit_start.summarize());
+        report.add_phase(name + ".start_end", gaps.start_end.summarize());
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef MY_CL_PROFILE_H
+#define MY_CL_PROFILE_H
+
+#include <CL/cl.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "bench_report.h"
+
+///
+/// \brief breaks OpenCL commands down into queued->submit->start->end gaps
+///
+/// Events must come from a queue created with CL_QUEUE_PROFILING_ENABLE.
+///
+class EventProfiler
+{
+public:
+    ///
+    /// \brief keep the event of a command until resolve()
+    ///
+    /// Nothing waits here, so profiling does not turn non-blocking commands
+    /// into blocking ones inside the timed phases.
+    ///
+    void record(const std::string& command, cl_event event);
+
+    ///
+    /// \brief wait for the kept events, record their gaps under their command
+    /// names, and release them; call outside the timed phases
+    ///
+    void resolve();
+
+    ///
+    /// \brief forget recorded gaps and release kept events without waiting
+    ///
+    void clear();
+
+    ///
+    /// \brief add phases "<command>.queued_submit", "<command>.submit_start"
+    /// and "<command>.start_end", in microseconds
+    ///
+    void add_to_report(BenchReport& report) const;
+
+protected:
+    struct CommandGaps
+    {
+        LatencyRecorder queued_submit;
+        LatencyRecorder submit_start;
+        LatencyRecorder start_end;
+    };
+
+    CommandGaps& get_gaps(const std::string& command);
+    void resolve_event(const std::string& command, cl_event event);
+
+    std::vector<std::pair<std::string, CommandGaps> > commands;
+    std::vector<std::pair<std::string, cl_event> > pending;
+};
+
+#endif // MY_CL_PROFILE_H
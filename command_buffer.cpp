@@ -0,0 +1,66 @@
+#include "command_buffer.h"
+#include "utils.h"
+
+#include <cstring>
+#include <vector>
+
+// OpenCL 3.0 names, defined here for older headers
+static const cl_device_info DEVICE_EXTENSIONS_WITH_VERSION = 0x1060;
+
+struct NameVersion
+{
+    cl_uint version;
+    char name[64];
+};
+
+static cl_uint make_version(cl_uint major, cl_uint minor, cl_uint patch)
+{
+    return ((major & 0x3ff) << 22) | ((minor & 0x3ff) << 12) | (patch & 0xfff);
+}
+
+static const char* EXTENSION_NAME = "cl_khr_command_buffer";
+
+bool CommandBufferApi::load(cl_platform_id plat, cl_device_id dev, const char*& why_not)
+{
+    if (get_dev_info_string(dev, CL_DEVICE_EXTENSIONS).find(EXTENSION_NAME) == std::string::npos)
+    {
+        why_not = "extension not supported";
+        return false;
+    }
+
+    size_t size = 0;
+    if (clGetDeviceInfo(dev, DEVICE_EXTENSIONS_WITH_VERSION, 0, nullptr, &size) != CL_SUCCESS || size == 0)
+    {
+        why_not = "extension version not reported";
+        return false;
+    }
+
+    std::vector<NameVersion> exts(size / sizeof(NameVersion));
+    clGetDeviceInfo(dev, DEVICE_EXTENSIONS_WITH_VERSION, exts.size() * sizeof(NameVersion), &exts[0], nullptr);
+
+    bool version_ok = false;
+    for (size_t i = 0; i < exts.size(); i++)
+    {
+        if (strncmp(exts[i].name, EXTENSION_NAME, sizeof(exts[i].name)) == 0)
+            version_ok = (exts[i].version == make_version(0, 9, 5));
+    }
+    if (!version_ok)
+    {
+        why_not = "unsupported extension revision";
+        return false;
+    }
+
+    create         = (CreateFunc) clGetExtensionFunctionAddressForPlatform(plat, "clCreateCommandBufferKHR");
+    finalize       = (FinalizeFunc) clGetExtensionFunctionAddressForPlatform(plat, "clFinalizeCommandBufferKHR");
+    release        = (ReleaseFunc) clGetExtensionFunctionAddressForPlatform(plat, "clReleaseCommandBufferKHR");
+    enqueue        = (EnqueueFunc) clGetExtensionFunctionAddressForPlatform(plat, "clEnqueueCommandBufferKHR");
+    copy_buffer    = (CopyBufferFunc) clGetExtensionFunctionAddressForPlatform(plat, "clCommandCopyBufferKHR");
+    ndrange_kernel = (NDRangeKernelFunc) clGetExtensionFunctionAddressForPlatform(plat, "clCommandNDRangeKernelKHR");
+    if (!create || !finalize || !release || !enqueue || !copy_buffer || !ndrange_kernel)
+    {
+        why_not = "entry points not found";
+        return false;
+    }
+
+    return true;
+}
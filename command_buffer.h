@@ -0,0 +1,55 @@
+#ifndef MY_COMMAND_BUFFER_H
+#define MY_COMMAND_BUFFER_H
+
+#include <CL/cl.h>
+
+//
+// cl_khr_command_buffer is still provisional, and its entry points changed
+// signature between revisions, so they are declared here under our own names
+// instead of relying on whichever cl_ext.h is installed. Only the revision
+// matching these declarations is loaded.
+//
+typedef struct _cl_command_buffer_khr* CommandBufferHandle;
+typedef cl_ulong CommandProperty;
+typedef cl_uint SyncPoint;
+
+///
+/// \brief entry points of cl_khr_command_buffer revision 0.9.5, loaded at runtime
+///
+struct CommandBufferApi
+{
+    typedef CommandBufferHandle (CL_API_CALL *CreateFunc)(cl_uint num_queues, const cl_command_queue* queues,
+                                                          const CommandProperty* properties, cl_int* errcode_ret);
+    typedef cl_int (CL_API_CALL *FinalizeFunc)(CommandBufferHandle command_buffer);
+    typedef cl_int (CL_API_CALL *ReleaseFunc)(CommandBufferHandle command_buffer);
+    typedef cl_int (CL_API_CALL *EnqueueFunc)(cl_uint num_queues, cl_command_queue* queues, CommandBufferHandle command_buffer,
+                                              cl_uint num_events_in_wait_list, const cl_event* event_wait_list, cl_event* event);
+    typedef cl_int (CL_API_CALL *CopyBufferFunc)(CommandBufferHandle command_buffer, cl_command_queue command_queue,
+                                                 const CommandProperty* properties,
+                                                 cl_mem src_buffer, cl_mem dst_buffer,
+                                                 size_t src_offset, size_t dst_offset, size_t size,
+                                                 cl_uint num_sync_points_in_wait_list, const SyncPoint* sync_point_wait_list,
+                                                 SyncPoint* sync_point, void* mutable_handle);
+    typedef cl_int (CL_API_CALL *NDRangeKernelFunc)(CommandBufferHandle command_buffer, cl_command_queue command_queue,
+                                                    const CommandProperty* properties, cl_kernel kernel, cl_uint work_dim,
+                                                    const size_t* global_work_offset, const size_t* global_work_size,
+                                                    const size_t* local_work_size,
+                                                    cl_uint num_sync_points_in_wait_list, const SyncPoint* sync_point_wait_list,
+                                                    SyncPoint* sync_point, void* mutable_handle);
+
+    CreateFunc create = nullptr;
+    FinalizeFunc finalize = nullptr;
+    ReleaseFunc release = nullptr;
+    EnqueueFunc enqueue = nullptr;
+    CopyBufferFunc copy_buffer = nullptr;
+    NDRangeKernelFunc ndrange_kernel = nullptr;
+
+    ///
+    /// \brief load the entry points if the device supports the extension in
+    /// revision 0.9.5, which needs OpenCL 3.0 to report extension versions
+    /// \return false if the extension can not be used, with the reason in why_not
+    ///
+    bool load(cl_platform_id plat, cl_device_id dev, const char*& why_not);
+};
+
+#endif // MY_COMMAND_BUFFER_H
@@ -0,0 +1,62 @@
+#include "completion_queue.h"
+#include "bench_report.h"
+
+cl_int CompletionQueue::watch(cl_event event, size_t tag)
+{
+    Watch* w = new Watch;
+    w->queue = this;
+    w->tag = tag;
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        num_watched++;
+    }
+
+    cl_int err = clSetEventCallback(event, CL_COMPLETE, on_event, w);
+    if (err != CL_SUCCESS)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        num_watched--;
+        delete w;
+    }
+    return err;
+}
+
+void CL_CALLBACK CompletionQueue::on_event(cl_event, cl_int status, void* user_data)
+{
+    Watch* w = (Watch*) user_data;
+    CompletionQueue* queue = w->queue;
+    Completion c;
+    c.tag = w->tag;
+    c.status = status;
+    c.time_us = now_us();
+    delete w;
+
+    // notify under the lock: once pop() can take the lock, the owner may
+    // destroy the queue, so nothing here may touch it after unlocking
+    std::lock_guard<std::mutex> guard(queue->lock);
+    queue->done.push_back(c);
+    queue->cond.notify_one();
+}
+
+CompletionQueue::Completion CompletionQueue::pop()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    if (done.empty())
+    {
+        double t0 = now_us();
+        cond.wait(guard, [this]() { return !done.empty(); });
+        wait_us += now_us() - t0;
+    }
+
+    Completion re = done.front();
+    done.pop_front();
+    num_popped++;
+    return re;
+}
+
+size_t CompletionQueue::get_num_pending() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return num_watched - num_popped;
+}
@@ -0,0 +1,73 @@
+#ifndef MY_COMPLETION_QUEUE_H
+#define MY_COMPLETION_QUEUE_H
+
+#include <CL/cl.h>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+///
+/// \brief completions of OpenCL commands, pushed by event callbacks and
+/// taken by the thread that drives the device
+///
+/// The callbacks run on a thread of the runtime, where they must not call
+/// back into OpenCL, so they only append (tag, status, time) under the lock
+/// and wake the driving thread. Completions come out in the order the
+/// callbacks fired, which may differ from the order of submission.
+///
+class CompletionQueue
+{
+public:
+    struct Completion
+    {
+        size_t tag;
+        cl_int status;  // CL_COMPLETE, or the negative error of the command
+        double time_us; // when the callback fired, see now_us()
+    };
+
+public:
+    CompletionQueue() {}
+
+    CompletionQueue(const CompletionQueue& other) = delete;
+    CompletionQueue& operator = (const CompletionQueue& other) = delete;
+
+    ///
+    /// \brief push a completion with tag when event finishes or fails
+    /// \return error of clSetEventCallback
+    ///
+    cl_int watch(cl_event event, size_t tag);
+
+    ///
+    /// \brief take the oldest completion, blocking until there is one
+    ///
+    Completion pop();
+
+    ///
+    /// \brief completions watched but not popped yet
+    ///
+    size_t get_num_pending() const;
+
+    ///
+    /// \brief total time pop() spent blocked, in microseconds
+    ///
+    double get_wait_us() const { return wait_us; }
+
+protected:
+    struct Watch
+    {
+        CompletionQueue* queue;
+        size_t tag;
+    };
+
+    static void CL_CALLBACK on_event(cl_event event, cl_int status, void* user_data);
+
+    mutable std::mutex lock;
+    std::condition_variable cond;
+    std::deque<Completion> done;
+    size_t num_watched = 0;
+    size_t num_popped = 0;
+    double wait_us = 0.0;
+};
+
+#endif // MY_COMPLETION_QUEUE_H
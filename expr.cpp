@@ -0,0 +1,474 @@
+#include "expr.h"
+#include "host_math.h"
+#include "utils.h"
+
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+//
+// recursive descent parser
+//
+class ExprParser
+{
+public:
+    ExprParser(Expr& expr, const std::string& text)
+        : expr(expr)
+        , text(text)
+    {
+    }
+
+    bool parse(std::string& error)
+    {
+        int re = parse_expr();
+        skip_space();
+        if (re >= 0 && pos != text.size())
+            fail("unexpected character");
+        if (!this->error.empty())
+        {
+            error = this->error;
+            return false;
+        }
+        expr.root = re;
+        return true;
+    }
+
+protected:
+    void skip_space()
+    {
+        while (pos < text.size() && isspace((unsigned char) text[pos])) pos++;
+    }
+
+    bool accept(char c)
+    {
+        skip_space();
+        if (pos < text.size() && text[pos] == c)
+        {
+            pos++;
+            return true;
+        }
+        return false;
+    }
+
+    int fail(const char* msg)
+    {
+        if (error.empty())
+        {
+            char buf[64];
+            snprintf(buf, sizeof(buf), " at position %lu", (unsigned long) pos);
+            error = std::string(msg) + buf;
+        }
+        return -1;
+    }
+
+    int parse_expr()
+    {
+        int lhs = parse_term();
+        while (lhs >= 0)
+        {
+            if (accept('+')) lhs = binary(Expr::NODE_ADD, lhs, parse_term());
+            else if (accept('-')) lhs = binary(Expr::NODE_SUB, lhs, parse_term());
+            else break;
+        }
+        return lhs;
+    }
+
+    int parse_term()
+    {
+        int lhs = parse_unary();
+        while (lhs >= 0)
+        {
+            if (accept('*')) lhs = binary(Expr::NODE_MUL, lhs, parse_unary());
+            else if (accept('/')) lhs = binary(Expr::NODE_DIV, lhs, parse_unary());
+            else break;
+        }
+        return lhs;
+    }
+
+    int parse_unary()
+    {
+        if (accept('-'))
+        {
+            int operand = parse_unary();
+            if (operand < 0) return -1;
+            return expr.add_node(Expr::NODE_NEG, 0.0f, operand, -1);
+        }
+        return parse_primary();
+    }
+
+    int parse_primary()
+    {
+        skip_space();
+        if (pos >= text.size())
+            return fail("unexpected end of formula");
+
+        if (accept('('))
+        {
+            int re = parse_expr();
+            if (re >= 0 && !accept(')')) return fail("expect ')'");
+            return re;
+        }
+
+        char c = text[pos];
+        if (isdigit((unsigned char) c) || c == '.')
+        {
+            const char* begin = text.c_str() + pos;
+            char* end = nullptr;
+            double value = strtod(begin, &end);
+            if (end == begin) return fail("invalid number");
+            if (!std::isfinite(float(value))) return fail("number out of float range");
+            pos += end - begin;
+            return expr.add_node(Expr::NODE_CONST, float(value), -1, -1);
+        }
+
+        if (isalpha((unsigned char) c))
+        {
+            size_t begin = pos;
+            while (pos < text.size() && isalnum((unsigned char) text[pos])) pos++;
+            std::string name = text.substr(begin, pos - begin);
+            if (name == "x")
+                return expr.add_node(Expr::NODE_VAR, 0.0f, -1, -1);
+
+            Expr::NodeType type;
+            if (name == "sin") type = Expr::NODE_SIN;
+            else if (name == "cos") type = Expr::NODE_COS;
+            else if (name == "tan") type = Expr::NODE_TAN;
+            else if (name == "sqrt") type = Expr::NODE_SQRT;
+            else if (name == "exp") type = Expr::NODE_EXP;
+            else if (name == "log") type = Expr::NODE_LOG;
+            else
+            {
+                pos = begin;
+                return fail("unknown name");
+            }
+
+            if (!accept('(')) return fail("expect '('");
+            int arg = parse_expr();
+            if (arg < 0) return -1;
+            if (!accept(')')) return fail("expect ')'");
+            return expr.add_node(type, 0.0f, arg, -1);
+        }
+
+        return fail("unexpected character");
+    }
+
+    int binary(Expr::NodeType type, int lhs, int rhs)
+    {
+        if (rhs < 0) return -1;
+        return expr.add_node(type, 0.0f, lhs, rhs);
+    }
+
+    Expr& expr;
+    const std::string& text;
+    size_t pos = 0;
+    std::string error;
+};
+
+bool Expr::parse(const std::string& text, std::string& error)
+{
+    this->text = text;
+    nodes.clear();
+    root = -1;
+
+    ExprParser parser(*this, text);
+    return parser.parse(error);
+}
+
+int Expr::add_node(NodeType type, float value, int lhs, int rhs)
+{
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        const Node& node = nodes[i];
+        if (node.type == type && node.lhs == lhs && node.rhs == rhs &&
+            (type != NODE_CONST || memcmp(&node.value, &value, sizeof(float)) == 0))
+            return int(i);
+    }
+
+    Node node;
+    node.type = type;
+    node.value = value;
+    node.lhs = lhs;
+    node.rhs = rhs;
+    nodes.push_back(node);
+    return int(nodes.size() - 1);
+}
+
+//
+// OpenCL C generation
+//
+static int precedence(Expr::NodeType type)
+{
+    switch (type)
+    {
+    case Expr::NODE_ADD:
+    case Expr::NODE_SUB: return 1;
+    case Expr::NODE_MUL:
+    case Expr::NODE_DIV: return 2;
+    case Expr::NODE_NEG: return 3;
+    default: return 4;
+    }
+}
+
+static const char* func_name(Expr::NodeType type)
+{
+    switch (type)
+    {
+    case Expr::NODE_SIN: return "sin";
+    case Expr::NODE_COS: return "cos";
+    case Expr::NODE_TAN: return "tan";
+    case Expr::NODE_SQRT: return "sqrt";
+    case Expr::NODE_EXP: return "exp";
+    case Expr::NODE_LOG: return "log";
+    default: return nullptr;
+    }
+}
+
+static std::string float_literal(float value, bool double_literal = false)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.9g", value);
+    std::string re = buf;
+    if (re.find_first_of(".e") == std::string::npos)
+        re += ".0";
+    return double_literal ? re : re + "f";
+}
+
+std::string Expr::node_to_opencl(int i_node, bool double_literals) const
+{
+    const Node& node = nodes[i_node];
+    switch (node.type)
+    {
+    case NODE_CONST:
+        return float_literal(node.value, double_literals);
+    case NODE_VAR:
+        return "x";
+    case NODE_NEG:
+    {
+        std::string operand = node_to_opencl(node.lhs, double_literals);
+        // also "-(-x)", as "--x" would be a decrement
+        if (precedence(nodes[node.lhs].type) <= precedence(NODE_NEG))
+            operand = "(" + operand + ")";
+        return "-" + operand;
+    }
+    case NODE_ADD:
+    case NODE_SUB:
+    case NODE_MUL:
+    case NODE_DIV:
+    {
+        static const char* ops[] = {" + ", " - ", " * ", " / "};
+        int prec = precedence(node.type);
+
+        // keep the left-to-right evaluation order, as float operations do not reassociate
+        std::string lhs = node_to_opencl(node.lhs, double_literals);
+        std::string rhs = node_to_opencl(node.rhs, double_literals);
+        if (precedence(nodes[node.lhs].type) < prec) lhs = "(" + lhs + ")";
+        if (precedence(nodes[node.rhs].type) <= prec) rhs = "(" + rhs + ")";
+        return lhs + ops[node.type - NODE_ADD] + rhs;
+    }
+    default:
+        return std::string(func_name(node.type)) + "(" + node_to_opencl(node.lhs, double_literals) + ")";
+    }
+}
+
+std::string Expr::to_opencl(bool double_literals) const
+{
+    return node_to_opencl(root, double_literals);
+}
+
+//
+// fused formulas
+//
+static bool is_operation(Expr::NodeType type)
+{
+    return type != Expr::NODE_CONST && type != Expr::NODE_VAR;
+}
+
+void FusedExpr::add(const Expr& expr)
+{
+    // children precede parents, so operands are already mapped
+    const std::vector<Expr::Node>& nodes = expr.get_nodes();
+    std::vector<int> map(nodes.size(), -1);
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        const Expr::Node& node = nodes[i];
+        int lhs = node.lhs >= 0 ? map[node.lhs] : -1;
+        int rhs = node.rhs >= 0 ? map[node.rhs] : -1;
+        map[i] = merged.add_node(node.type, node.value, lhs, rhs);
+        if (is_operation(node.type)) num_op_separate++;
+    }
+    roots.push_back(map[expr.get_root()]);
+}
+
+size_t FusedExpr::get_num_op() const
+{
+    size_t re = 0;
+    for (size_t i = 0; i < merged.nodes.size(); i++)
+        if (is_operation(merged.nodes[i].type)) re++;
+    return re;
+}
+
+std::string FusedExpr::operand(int i_node) const
+{
+    const Expr::Node& node = merged.nodes[i_node];
+    if (node.type == Expr::NODE_CONST) return float_literal(node.value);
+    if (node.type == Expr::NODE_VAR) return "x";
+    char buf[32];
+    snprintf(buf, sizeof(buf), "t%d", i_node);
+    return buf;
+}
+
+std::string FusedExpr::to_opencl(const std::string& value_type, const std::string& indent) const
+{
+    std::string re;
+    for (size_t i = 0; i < merged.nodes.size(); i++)
+    {
+        const Expr::Node& node = merged.nodes[i];
+        if (!is_operation(node.type)) continue;
+
+        std::string value;
+        switch (node.type)
+        {
+        case Expr::NODE_NEG:
+            value = "-" + operand(node.lhs);
+            break;
+        case Expr::NODE_ADD:
+        case Expr::NODE_SUB:
+        case Expr::NODE_MUL:
+        case Expr::NODE_DIV:
+        {
+            static const char* ops[] = {" + ", " - ", " * ", " / "};
+            value = operand(node.lhs) + ops[node.type - Expr::NODE_ADD] + operand(node.rhs);
+            break;
+        }
+        default:
+            value = std::string(func_name(node.type)) + "(" + operand(node.lhs) + ")";
+        }
+        re += indent + value_type + " " + operand(int(i)) + " = " + value + ";\n";
+    }
+    return re;
+}
+
+std::string FusedExpr::get_result(size_t i) const
+{
+    return operand(roots[i]);
+}
+
+std::string Expr::get_hash() const
+{
+    return hash_to_hex(hash_fnv1a(to_opencl()));
+}
+
+//
+// host evaluation
+//
+static const size_t EVAL_BLOCK = 256;
+
+void Expr::eval_host(const float* in, float* out, size_t n) const
+{
+    eval_blocks(in, out, n, false);
+}
+
+void Expr::eval_ref(const float* in, float* out, size_t n) const
+{
+    eval_blocks(in, out, n, true);
+}
+
+static void ref_func(double (*func)(double), const float* a, float* dst, size_t len)
+{
+    for (size_t i = 0; i < len; i++) dst[i] = float(func(double(a[i])));
+}
+
+static double sin_d(double x) { return std::sin(x); }
+static double cos_d(double x) { return std::cos(x); }
+static double tan_d(double x) { return std::tan(x); }
+
+void Expr::eval_blocks(const float* in, float* out, size_t n, bool reference) const
+{
+    // one block-sized slot per node, small enough to stay in L1/L2; host
+    // workers call this once per chunk, so each thread keeps its own and only
+    // grows it for larger formulas
+    static thread_local std::vector<float> scratch;
+    if (scratch.size() < nodes.size() * EVAL_BLOCK)
+        scratch.resize(nodes.size() * EVAL_BLOCK);
+
+    for (size_t begin = 0; begin < n; begin += EVAL_BLOCK)
+    {
+        size_t len = (n - begin < EVAL_BLOCK) ? n - begin : EVAL_BLOCK;
+
+        for (size_t i_node = 0; i_node < nodes.size(); i_node++)
+        {
+            const Node& node = nodes[i_node];
+            float* dst = &scratch[i_node * EVAL_BLOCK];
+            const float* a = node.lhs >= 0 ? &scratch[node.lhs * EVAL_BLOCK] : nullptr;
+            const float* b = node.rhs >= 0 ? &scratch[node.rhs * EVAL_BLOCK] : nullptr;
+
+            switch (node.type)
+            {
+            case NODE_CONST: for (size_t i = 0; i < len; i++) dst[i] = node.value; break;
+            case NODE_VAR:   memcpy(dst, in + begin, len * sizeof(float)); break;
+            case NODE_NEG:   for (size_t i = 0; i < len; i++) dst[i] = -a[i]; break;
+            case NODE_ADD:   for (size_t i = 0; i < len; i++) dst[i] = a[i] + b[i]; break;
+            case NODE_SUB:   for (size_t i = 0; i < len; i++) dst[i] = a[i] - b[i]; break;
+            case NODE_MUL:   for (size_t i = 0; i < len; i++) dst[i] = a[i] * b[i]; break;
+            case NODE_DIV:   for (size_t i = 0; i < len; i++) dst[i] = a[i] / b[i]; break;
+            case NODE_SIN:   reference ? ref_func(sin_d, a, dst, len) : host_sin(a, dst, len); break;
+            case NODE_COS:   reference ? ref_func(cos_d, a, dst, len) : host_cos(a, dst, len); break;
+            case NODE_TAN:   reference ? ref_func(tan_d, a, dst, len) : host_tan(a, dst, len); break;
+            case NODE_SQRT:  for (size_t i = 0; i < len; i++) dst[i] = std::sqrt(a[i]); break;
+            case NODE_EXP:
+                if (reference) ref_func(std::exp, a, dst, len);
+                else for (size_t i = 0; i < len; i++) dst[i] = std::exp(a[i]);
+                break;
+            case NODE_LOG:
+                if (reference) ref_func(std::log, a, dst, len);
+                else for (size_t i = 0; i < len; i++) dst[i] = std::log(a[i]);
+                break;
+            default: abort();
+            }
+        }
+
+        memcpy(out + begin, &scratch[root * EVAL_BLOCK], len * sizeof(float));
+    }
+}
+
+float Expr::eval_ref(float x) const
+{
+    // nodes are few, a fixed buffer avoids allocating per sample
+    float stack_values[64];
+    std::vector<float> heap_values;
+    float* values = stack_values;
+    if (nodes.size() > 64)
+    {
+        heap_values.resize(nodes.size());
+        values = &heap_values[0];
+    }
+
+    for (size_t i_node = 0; i_node < nodes.size(); i_node++)
+    {
+        const Node& node = nodes[i_node];
+        float a = node.lhs >= 0 ? values[node.lhs] : 0.0f;
+        float b = node.rhs >= 0 ? values[node.rhs] : 0.0f;
+        float& dst = values[i_node];
+
+        switch (node.type)
+        {
+        case NODE_CONST: dst = node.value; break;
+        case NODE_VAR:   dst = x; break;
+        case NODE_NEG:   dst = -a; break;
+        case NODE_ADD:   dst = a + b; break;
+        case NODE_SUB:   dst = a - b; break;
+        case NODE_MUL:   dst = a * b; break;
+        case NODE_DIV:   dst = a / b; break;
+        case NODE_SIN:   dst = float(std::sin(double(a))); break;
+        case NODE_COS:   dst = float(std::cos(double(a))); break;
+        case NODE_TAN:   dst = float(std::tan(double(a))); break;
+        case NODE_SQRT:  dst = float(std::sqrt(double(a))); break;
+        case NODE_EXP:   dst = float(std::exp(double(a))); break;
+        case NODE_LOG:   dst = float(std::log(double(a))); break;
+        default: abort();
+        }
+    }
+    return values[root];
+}
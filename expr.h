@@ -0,0 +1,146 @@
+#ifndef MY_EXPR_H
+#define MY_EXPR_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+///
+/// \brief single-variable formula over the input sample x
+///
+/// Grammar:
+///   expr    := term (('+' | '-') term)*
+///   term    := unary (('*' | '/') unary)*
+///   unary   := '-' unary | primary
+///   primary := number | 'x' | func '(' expr ')' | '(' expr ')'
+///   func    := sin | cos | tan | sqrt | exp | log
+///
+/// Identical subexpressions are stored once, so "sin(x*x) + cos(x*x)" holds a
+/// single x*x node. The same tree produces the OpenCL C expression, the host
+/// implementation and the reference values.
+///
+class Expr
+{
+public:
+    enum NodeType
+    {
+        NODE_CONST,
+        NODE_VAR,
+        NODE_NEG,
+        NODE_ADD,
+        NODE_SUB,
+        NODE_MUL,
+        NODE_DIV,
+        NODE_SIN,
+        NODE_COS,
+        NODE_TAN,
+        NODE_SQRT,
+        NODE_EXP,
+        NODE_LOG,
+    };
+
+    struct Node
+    {
+        NodeType type;
+        float value; // NODE_CONST only
+        int lhs;     // operand of unary nodes and functions
+        int rhs;
+    };
+
+public:
+    ///
+    /// \brief parse text into this expression
+    /// \return false with a message in error if text is not a valid formula
+    ///
+    bool parse(const std::string& text, std::string& error);
+
+    const std::string& get_text() const { return text; }
+
+    ///
+    /// \brief OpenCL C expression over variable "x"
+    ///
+    /// Constants are float literals, so the expression is valid for float and
+    /// floatN x, and evaluates in single precision like the host path. With
+    /// double_literals they have no suffix, for kernels calculating in double.
+    ///
+    std::string to_opencl(bool double_literals = false) const;
+
+    ///
+    /// \brief hash of the canonical form, equal for formulas that only differ in spacing
+    ///
+    std::string get_hash() const;
+
+    ///
+    /// \brief evaluate out[i] = f(in[i]) in single precision, blockwise with the
+    /// vectorized trigonometry of host_math.h
+    ///
+    void eval_host(const float* in, float* out, size_t n) const;
+
+    ///
+    /// \brief reference value: the same single-precision arithmetic, with every
+    /// function correctly rounded from its double-precision result
+    ///
+    float eval_ref(float x) const;
+
+    ///
+    /// \brief eval_ref() of n samples, blockwise like eval_host()
+    ///
+    void eval_ref(const float* in, float* out, size_t n) const;
+
+    const std::vector<Node>& get_nodes() const { return nodes; }
+    int get_root() const { return root; }
+
+protected:
+    int add_node(NodeType type, float value, int lhs, int rhs);
+    std::string node_to_opencl(int i_node, bool double_literals) const;
+    void eval_blocks(const float* in, float* out, size_t n, bool reference) const;
+
+    std::string text;
+    std::vector<Node> nodes; // children always precede their parents
+    int root = -1;
+
+    friend class ExprParser;
+    friend class FusedExpr;
+};
+
+///
+/// \brief several formulas over the same x merged into one graph, so that
+/// subexpressions they share are calculated once
+///
+/// The generated code keeps every operation in its own statement, so each is
+/// rounded to the value type like in a single formula, but a multiply and an
+/// add in different statements are not contracted into one fma.
+///
+class FusedExpr
+{
+public:
+    void add(const Expr& expr);
+
+    size_t get_num_formula() const { return roots.size(); }
+
+    ///
+    /// \brief operations of the merged graph, and of the formulas on their own
+    ///
+    size_t get_num_op() const;
+    size_t get_num_op_separate() const { return num_op_separate; }
+
+    ///
+    /// \brief OpenCL C statements over "x" that declare one temporary of
+    /// value_type per operation, each line starting with indent
+    ///
+    std::string to_opencl(const std::string& value_type, const std::string& indent) const;
+
+    ///
+    /// \brief OpenCL C value of formula i after the statements of to_opencl()
+    ///
+    std::string get_result(size_t i) const;
+
+protected:
+    std::string operand(int i_node) const;
+
+    Expr merged;
+    std::vector<int> roots;
+    size_t num_op_separate = 0;
+};
+
+#endif // MY_EXPR_H
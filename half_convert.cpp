@@ -0,0 +1,145 @@
+#include "half_convert.h"
+
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_F16C_PATH 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+static inline uint32_t float_bits(float value)
+{
+    uint32_t re;
+    memcpy(&re, &value, sizeof(re));
+    return re;
+}
+
+static inline float bits_float(uint32_t value)
+{
+    float re;
+    memcpy(&re, &value, sizeof(re));
+    return re;
+}
+
+uint16_t float_to_half(float value)
+{
+    uint32_t bits = float_bits(value);
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t abs = bits & 0x7fffffff;
+
+    // NaN keeps the top of its payload and becomes quiet
+    if (abs > 0x7f800000)
+        return uint16_t(sign | 0x7e00 | ((abs >> 13) & 0x3ff));
+
+    // 65520 and above, and infinity, round to infinity
+    if (abs >= 0x477ff000)
+        return uint16_t(sign | 0x7c00);
+
+    // below 2^-14 the result is subnormal: adding 0.5 aligns the half ulp
+    // 2^-24 with the float ulp, so the float adder does the rounding
+    if (abs < 0x38800000)
+        return uint16_t(sign | (float_bits(bits_float(abs) + 0.5f) - float_bits(0.5f)));
+
+    // rebias the exponent and round the 13 dropped bits to nearest even
+    uint32_t mant_odd = (abs >> 13) & 1;
+    abs += 0xc8000fff; // (15 - 127) << 23, plus half an ulp minus one
+    abs += mant_odd;
+    return uint16_t(sign | (abs >> 13));
+}
+
+float half_to_float(uint16_t value)
+{
+    uint32_t sign = uint32_t(value & 0x8000) << 16;
+    uint32_t exp = (value >> 10) & 0x1f;
+    uint32_t mant = value & 0x3ff;
+
+    if (exp == 0x1f)
+        return bits_float(sign | 0x7f800000 | ((mant ? mant | 0x200 : 0) << 13));
+    if (exp == 0)
+    {
+        // zero or subnormal, mant * 2^-24 is exact in float
+        float abs = float(mant) * 5.9604644775390625e-8f;
+        return bits_float(sign | float_bits(abs));
+    }
+    return bits_float(sign | ((exp + 112) << 23) | (mant << 13));
+}
+
+#ifdef HAVE_F16C_PATH
+
+bool host_has_f16c()
+{
+    static const bool re = [] {
+        unsigned int a = 0, b = 0, c = 0, d = 0;
+        if (!__get_cpuid(1, &a, &b, &c, &d)) return false;
+        const unsigned int OSXSAVE = 1u << 27, AVX = 1u << 28, F16C = 1u << 29;
+        if ((c & (OSXSAVE | AVX | F16C)) != (OSXSAVE | AVX | F16C)) return false;
+
+        // the OS must save the YMM state
+        unsigned int xcr0_lo = 0, xcr0_hi = 0;
+        __asm__ ("xgetbv" : "=a" (xcr0_lo), "=d" (xcr0_hi) : "c" (0));
+        return (xcr0_lo & 6) == 6;
+    }();
+    return re;
+}
+
+__attribute__((target("avx,f16c")))
+static void floats_to_halves_f16c(const float* in, uint16_t* out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), h);
+    }
+    for (; i < n; i++)
+        out[i] = float_to_half(in[i]);
+}
+
+__attribute__((target("avx,f16c")))
+static void halves_to_floats_f16c(const uint16_t* in, float* out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        _mm256_storeu_ps(out + i, _mm256_cvtph_ps(h));
+    }
+    for (; i < n; i++)
+        out[i] = half_to_float(in[i]);
+}
+
+#else
+
+bool host_has_f16c()
+{
+    return false;
+}
+
+#endif
+
+void floats_to_halves(const float* in, uint16_t* out, size_t n)
+{
+#ifdef HAVE_F16C_PATH
+    if (host_has_f16c())
+    {
+        floats_to_halves_f16c(in, out, n);
+        return;
+    }
+#endif
+    for (size_t i = 0; i < n; i++)
+        out[i] = float_to_half(in[i]);
+}
+
+void halves_to_floats(const uint16_t* in, float* out, size_t n)
+{
+#ifdef HAVE_F16C_PATH
+    if (host_has_f16c())
+    {
+        halves_to_floats_f16c(in, out, n);
+        return;
+    }
+#endif
+    for (size_t i = 0; i < n; i++)
+        out[i] = half_to_float(in[i]);
+}
@@ -0,0 +1,28 @@
+#ifndef MY_HALF_CONVERT_H
+#define MY_HALF_CONVERT_H
+
+#include <cstddef>
+#include <stdint.h>
+
+//
+// Conversion between float and IEEE 754 binary16 stored as uint16_t, with
+// round-to-nearest-even like vstore_half in OpenCL C. Arrays are converted
+// with F16C 8 lanes at a time when the CPU has it, checked at runtime, and
+// element by element otherwise; both paths give the same bits, including
+// overflow to infinity, subnormals and quieted NaN payloads.
+//
+
+uint16_t float_to_half(float value);
+
+float half_to_float(uint16_t value);
+
+void floats_to_halves(const float* in, uint16_t* out, size_t n);
+
+void halves_to_floats(const uint16_t* in, float* out, size_t n);
+
+///
+/// \brief whether the array conversions take the F16C path
+///
+bool host_has_f16c();
+
+#endif // MY_HALF_CONVERT_H
@@ -0,0 +1,194 @@
+#include "host_math.h"
+
+#include <cmath>
+#include <cstdlib>
+
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+// beyond this, j * PIO2_n in reduce_half_pi() is no longer exact
+static const double REDUCE_LIMIT = 1099511627776.0; // 2^40
+
+#ifdef __AVX__
+
+#ifdef __FMA__
+#define MADD(a, b, c) _mm256_fmadd_ps(a, b, c)
+#else
+#define MADD(a, b, c) _mm256_add_ps(_mm256_mul_ps(a, b), c)
+#endif
+
+// lanes that can not be reduced accurately, including NaN and infinity
+static inline int out_of_range(__m256 x)
+{
+    const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    __m256 ax = _mm256_and_ps(x, abs_mask);
+    return _mm256_movemask_ps(_mm256_cmp_ps(ax, _mm256_set1_ps(float(REDUCE_LIMIT)), _CMP_NLT_UQ));
+}
+
+// x = j * pi/2 + r, |r| <= pi/4; q = j mod 4
+// Cody-Waite reduction with pi/2 split into 12-bit pieces, so that each
+// j * PIO2[k] is exact for |j| <= 2^41.
+static inline void reduce_half_pi(__m256d x, __m128& r, __m128& q)
+{
+    static const double PIO2[6] = {
+        1.5703125,
+        0.0004837512969970703,
+        7.549533620476723e-08,
+        2.5632829192545614e-12,
+        6.123031769111886e-17,
+        2.0222662487959506e-21, // remainder, not truncated
+    };
+    const __m256d INV_PIO2 = _mm256_set1_pd(6.36619772367581382433e-01);
+
+    __m256d j = _mm256_round_pd(_mm256_mul_pd(x, INV_PIO2), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256d rd = x;
+    for (int k = 0; k < 6; k++)
+        rd = _mm256_sub_pd(rd, _mm256_mul_pd(j, _mm256_set1_pd(PIO2[k])));
+    __m256d qd = _mm256_sub_pd(j, _mm256_mul_pd(_mm256_set1_pd(4.0),
+                                                _mm256_floor_pd(_mm256_mul_pd(j, _mm256_set1_pd(0.25)))));
+    r = _mm256_cvtpd_ps(rd);
+    q = _mm256_cvtpd_ps(qd);
+}
+
+static inline void reduce_half_pi(__m256 x, __m256& r, __m256& q)
+{
+    __m128 r_lo, r_hi, q_lo, q_hi;
+    reduce_half_pi(_mm256_cvtps_pd(_mm256_castps256_ps128(x)), r_lo, q_lo);
+    reduce_half_pi(_mm256_cvtps_pd(_mm256_extractf128_ps(x, 1)), r_hi, q_hi);
+    r = _mm256_insertf128_ps(_mm256_castps128_ps256(r_lo), r_hi, 1);
+    q = _mm256_insertf128_ps(_mm256_castps128_ps256(q_lo), q_hi, 1);
+}
+
+// minimax polynomials on [-pi/4, pi/4], coefficients from Cephes
+static inline __m256 sin_poly(__m256 r, __m256 z)
+{
+    __m256 p = MADD(_mm256_set1_ps(-1.9515295891e-4f), z, _mm256_set1_ps(8.3321608736e-3f));
+    p = MADD(p, z, _mm256_set1_ps(-1.6666654611e-1f));
+    return MADD(_mm256_mul_ps(p, z), r, r);
+}
+
+static inline __m256 cos_poly(__m256 z)
+{
+    __m256 p = MADD(_mm256_set1_ps(2.443315711809948e-5f), z, _mm256_set1_ps(-1.388731625493765e-3f));
+    p = MADD(p, z, _mm256_set1_ps(4.166664568298827e-2f));
+    p = _mm256_mul_ps(_mm256_mul_ps(p, z), z);
+    return _mm256_add_ps(MADD(_mm256_set1_ps(-0.5f), z, _mm256_set1_ps(1.0f)), p);
+}
+
+static inline __m256 tan_poly(__m256 r, __m256 z)
+{
+    __m256 p = MADD(_mm256_set1_ps(9.38540185543e-3f), z, _mm256_set1_ps(3.11992232697e-3f));
+    p = MADD(p, z, _mm256_set1_ps(2.44301354525e-2f));
+    p = MADD(p, z, _mm256_set1_ps(5.34112807005e-2f));
+    p = MADD(p, z, _mm256_set1_ps(1.33387994085e-1f));
+    p = MADD(p, z, _mm256_set1_ps(3.33331568548e-1f));
+    return MADD(_mm256_mul_ps(p, z), r, r);
+}
+
+static inline __m256 quadrant_is(__m256 q, float value)
+{
+    return _mm256_cmp_ps(q, _mm256_set1_ps(value), _CMP_EQ_OQ);
+}
+
+static inline __m256 negate_if(__m256 v, __m256 mask)
+{
+    return _mm256_xor_ps(v, _mm256_and_ps(mask, _mm256_set1_ps(-0.0f)));
+}
+
+static inline __m256 sin_ps(__m256 x)
+{
+    __m256 r, q;
+    reduce_half_pi(x, r, q);
+    __m256 z = _mm256_mul_ps(r, r);
+    __m256 s = sin_poly(r, z);
+    __m256 c = cos_poly(z);
+
+    __m256 odd = _mm256_or_ps(quadrant_is(q, 1.0f), quadrant_is(q, 3.0f));
+    __m256 neg = _mm256_cmp_ps(q, _mm256_set1_ps(2.0f), _CMP_GE_OQ);
+    return negate_if(_mm256_blendv_ps(s, c, odd), neg);
+}
+
+static inline __m256 cos_ps(__m256 x)
+{
+    __m256 r, q;
+    reduce_half_pi(x, r, q);
+    __m256 z = _mm256_mul_ps(r, r);
+    __m256 s = sin_poly(r, z);
+    __m256 c = cos_poly(z);
+
+    __m256 odd = _mm256_or_ps(quadrant_is(q, 1.0f), quadrant_is(q, 3.0f));
+    __m256 neg = _mm256_or_ps(quadrant_is(q, 1.0f), quadrant_is(q, 2.0f));
+    return negate_if(_mm256_blendv_ps(c, s, odd), neg);
+}
+
+static inline __m256 tan_ps(__m256 x)
+{
+    __m256 r, q;
+    reduce_half_pi(x, r, q);
+    __m256 t = tan_poly(r, _mm256_mul_ps(r, r));
+
+    // tan(r + pi/2) = -1 / tan(r)
+    __m256 odd = _mm256_or_ps(quadrant_is(q, 1.0f), quadrant_is(q, 3.0f));
+    __m256 inv = _mm256_div_ps(_mm256_set1_ps(-1.0f), t);
+    return _mm256_blendv_ps(t, inv, odd);
+}
+
+template<__m256 (*func)(__m256), double (*func_scalar)(double)>
+static void apply_ps(const float* in, float* out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 x = _mm256_loadu_ps(in + i);
+        if (out_of_range(x))
+        {
+            for (size_t j = i; j < i + 8; j++)
+                out[j] = float(func_scalar(in[j]));
+        }
+        else
+        {
+            _mm256_storeu_ps(out + i, func(x));
+        }
+    }
+    for (; i < n; i++)
+        out[i] = float(func_scalar(in[i]));
+}
+
+static double sin_d(double x) { return std::sin(x); }
+static double cos_d(double x) { return std::cos(x); }
+static double tan_d(double x) { return std::tan(x); }
+
+void host_sin(const float* in, float* out, size_t n)
+{
+    apply_ps<sin_ps, sin_d>(in, out, n);
+}
+
+void host_cos(const float* in, float* out, size_t n)
+{
+    apply_ps<cos_ps, cos_d>(in, out, n);
+}
+
+void host_tan(const float* in, float* out, size_t n)
+{
+    apply_ps<tan_ps, tan_d>(in, out, n);
+}
+
+#else // no AVX: scalar fallback
+
+void host_sin(const float* in, float* out, size_t n)
+{
+    for (size_t i = 0; i < n; i++) out[i] = float(std::sin(double(in[i])));
+}
+
+void host_cos(const float* in, float* out, size_t n)
+{
+    for (size_t i = 0; i < n; i++) out[i] = float(std::cos(double(in[i])));
+}
+
+void host_tan(const float* in, float* out, size_t n)
+{
+    for (size_t i = 0; i < n; i++) out[i] = float(std::tan(double(in[i])));
+}
+
+#endif
@@ -0,0 +1,172 @@
+#include "input_gen.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+namespace htio2
+{
+template<>
+bool from_string<InputDist>(const std::string& input, InputDist& result)
+{
+    if (input == "ramp") result = INPUT_DIST_RAMP;
+    else if (input == "uniform") result = INPUT_DIST_UNIFORM;
+    else if (input == "normal") result = INPUT_DIST_NORMAL;
+    else return false;
+    return true;
+}
+
+template<>
+std::string to_string<InputDist>(InputDist input)
+{
+    switch (input)
+    {
+    case INPUT_DIST_RAMP: return "ramp";
+    case INPUT_DIST_UNIFORM: return "uniform";
+    case INPUT_DIST_NORMAL: return "normal";
+    case INPUT_DIST_INVALID: return "invalid";
+    default: abort();
+    }
+}
+
+template<>
+bool from_string<InputSource>(const std::string& input, InputSource& result)
+{
+    if (input == "host") result = INPUT_SOURCE_HOST;
+    else if (input == "device") result = INPUT_SOURCE_DEVICE;
+    else if (input == "resident") result = INPUT_SOURCE_RESIDENT;
+    else return false;
+    return true;
+}
+
+template<>
+std::string to_string<InputSource>(InputSource input)
+{
+    switch (input)
+    {
+    case INPUT_SOURCE_HOST: return "host";
+    case INPUT_SOURCE_DEVICE: return "device";
+    case INPUT_SOURCE_RESIDENT: return "resident";
+    case INPUT_SOURCE_INVALID: return "invalid";
+    default: abort();
+    }
+}
+
+} // namespace htio2
+
+static const uint32_t PHILOX_M0 = 0xD2511F53;
+static const uint32_t PHILOX_M1 = 0xCD9E8D57;
+static const uint32_t PHILOX_W0 = 0x9E3779B9;
+static const uint32_t PHILOX_W1 = 0xBB67AE85;
+
+static inline uint32_t mul_hi(uint32_t a, uint32_t b)
+{
+    return uint32_t((uint64_t(a) * b) >> 32);
+}
+
+static void philox4x32_10(uint64_t counter, uint64_t seed, uint32_t out[4])
+{
+    uint32_t c0 = uint32_t(counter), c1 = uint32_t(counter >> 32), c2 = 0, c3 = 0;
+    uint32_t k0 = uint32_t(seed), k1 = uint32_t(seed >> 32);
+    for (int i = 0; i < 10; i++)
+    {
+        uint32_t hi0 = mul_hi(PHILOX_M0, c0), lo0 = PHILOX_M0 * c0;
+        uint32_t hi1 = mul_hi(PHILOX_M1, c2), lo1 = PHILOX_M1 * c2;
+        c0 = hi1 ^ c1 ^ k0;
+        c1 = lo1;
+        c2 = hi0 ^ c3 ^ k1;
+        c3 = lo0;
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+}
+
+// 2^-24, and 1 / sqrt(var) of the centered sum below, the same literals on both sides
+#define UNIFORM_SCALE 5.9604644775390625e-8f
+#define NORMAL_SCALE 9.34406216e-06f
+#define LITERAL_TEXT(x) #x
+#define LITERAL(x) LITERAL_TEXT(x)
+
+void generate_input(InputDist dist, uint64_t seed, int64_t begin, float* out, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        int64_t idx = begin + int64_t(i);
+        if (dist == INPUT_DIST_RAMP)
+        {
+            out[i] = float(idx);
+            continue;
+        }
+
+        uint32_t r[4];
+        philox4x32_10(uint64_t(idx), seed, r);
+        if (dist == INPUT_DIST_UNIFORM)
+        {
+            out[i] = float(r[0] >> 8) * UNIFORM_SCALE;
+        }
+        else if (dist == INPUT_DIST_NORMAL)
+        {
+            // 2 * sum - 8 * 65535 is centered, and stays exact in float
+            int32_t sum = 0;
+            for (int k = 0; k < 4; k++)
+                sum += int32_t(r[k] & 0xffff) + int32_t(r[k] >> 16);
+            out[i] = float(2 * sum - 8 * 65535) * NORMAL_SCALE;
+        }
+        else
+        {
+            abort();
+        }
+    }
+}
+
+std::string make_input_source(InputDist dist, uint64_t seed)
+{
+    if (dist == INPUT_DIST_RAMP)
+        return "float gen_input(long idx) { return convert_float(idx); }\n";
+
+    char seed_text[64];
+    snprintf(seed_text, sizeof(seed_text), "0x%016llxUL", (unsigned long long) seed);
+
+    std::string philox =
+        "uint4 philox4x32_10(ulong counter, ulong seed)\n"
+        "{\n"
+        "    uint4 c = (uint4)((uint) counter, (uint) (counter >> 32), 0, 0);\n"
+        "    uint k0 = (uint) seed, k1 = (uint) (seed >> 32);\n"
+        "    for (int i = 0; i < 10; i++)\n"
+        "    {\n"
+        "        uint hi0 = mul_hi(0xD2511F53u, c.x), lo0 = 0xD2511F53u * c.x;\n"
+        "        uint hi1 = mul_hi(0xCD9E8D57u, c.z), lo1 = 0xCD9E8D57u * c.z;\n"
+        "        c = (uint4)(hi1 ^ c.y ^ k0, lo1, hi0 ^ c.w ^ k1, lo0);\n"
+        "        k0 += 0x9E3779B9u;\n"
+        "        k1 += 0xBB67AE85u;\n"
+        "    }\n"
+        "    return c;\n"
+        "}\n";
+
+    std::string body;
+    if (dist == INPUT_DIST_UNIFORM)
+    {
+        body = "    return convert_float(r.x >> 8) * " LITERAL(UNIFORM_SCALE) ";\n";
+    }
+    else if (dist == INPUT_DIST_NORMAL)
+    {
+        body =
+            "    int sum = (int) ((r.x & 0xffff) + (r.x >> 16) + (r.y & 0xffff) + (r.y >> 16) +\n"
+            "                     (r.z & 0xffff) + (r.z >> 16) + (r.w & 0xffff) + (r.w >> 16));\n"
+            "    return convert_float(2 * sum - 8 * 65535) * " LITERAL(NORMAL_SCALE) ";\n";
+    }
+    else
+    {
+        abort();
+    }
+
+    return philox +
+        "float gen_input(long idx)\n"
+        "{\n"
+        "    uint4 r = philox4x32_10((ulong) idx, " + std::string(seed_text) + ");\n" +
+        body +
+        "}\n";
+}
@@ -0,0 +1,65 @@
+#ifndef MY_INPUT_GEN_H
+#define MY_INPUT_GEN_H
+
+#include <cstddef>
+#include <stdint.h>
+#include <string>
+
+#include "htio2/Cast.h"
+
+typedef enum {
+    INPUT_DIST_RAMP = 0,    // x = index
+    INPUT_DIST_UNIFORM = 1, // uniform in [0, 1) on a grid of 2^-24
+    INPUT_DIST_NORMAL = 2,  // approximately standard normal, see below
+    INPUT_DIST_INVALID = 255,
+} InputDist;
+
+typedef enum {
+    INPUT_SOURCE_HOST = 0,     // generated on the host and uploaded every iteration
+    INPUT_SOURCE_DEVICE = 1,   // generated by the kernel itself, nothing is uploaded
+    INPUT_SOURCE_RESIDENT = 2, // uploaded once, then reused from the device buffer
+    INPUT_SOURCE_INVALID = 255,
+} InputSource;
+
+namespace htio2
+{
+template<>
+bool from_string<InputDist>(const std::string& input, InputDist& result);
+
+template<>
+std::string to_string<InputDist>(InputDist input);
+
+template<>
+bool from_string<InputSource>(const std::string& input, InputSource& result);
+
+template<>
+std::string to_string<InputSource>(InputSource input);
+
+} // namespace htio2
+
+//
+// Random inputs come from Philox4x32-10 keyed by the seed, with the sample
+// index as counter, so any sample can be generated on its own, in any order,
+// on host or device. Each value is derived with integer operations and at
+// most one float conversion and one float multiply, all exact or correctly
+// rounded in both C++ and OpenCL C, so host and device values are identical
+// bit for bit.
+//
+// Normal values are the Irwin-Hall sum of the eight 16-bit halves of one
+// Philox output, centered and scaled to unit variance. Their range is bounded
+// by about +-4.9, which is fine for driving a benchmark but not for sampling
+// tails.
+//
+
+///
+/// \brief host values of samples [begin, begin + n)
+///
+void generate_input(InputDist dist, uint64_t seed, int64_t begin, float* out, size_t n);
+
+///
+/// \brief OpenCL C source of "float gen_input(long idx)" returning the same
+/// value as generate_input() for sample idx
+///
+std::string make_input_source(InputDist dist, uint64_t seed);
+
+#endif // MY_INPUT_GEN_H
@@ -0,0 +1,209 @@
+#include "kernel_source.h"
+#include "expr.h"
+#include "storage_traits.h"
+
+#include <cstdlib>
+
+namespace htio2
+{
+template<>
+bool from_string<KernelLayout>(const std::string& input, KernelLayout& result)
+{
+    if (input == "chunked") result = KERNEL_LAYOUT_CHUNKED;
+    else if (input == "interleaved") result = KERNEL_LAYOUT_INTERLEAVED;
+    else if (input == "vec4") result = KERNEL_LAYOUT_VEC4;
+    else if (input == "vec8") result = KERNEL_LAYOUT_VEC8;
+    else if (input == "single") result = KERNEL_LAYOUT_SINGLE;
+    else return false;
+    return true;
+}
+
+template<>
+std::string to_string<KernelLayout>(KernelLayout input)
+{
+    switch (input)
+    {
+    case KERNEL_LAYOUT_CHUNKED: return "chunked";
+    case KERNEL_LAYOUT_INTERLEAVED: return "interleaved";
+    case KERNEL_LAYOUT_VEC4: return "vec4";
+    case KERNEL_LAYOUT_VEC8: return "vec8";
+    case KERNEL_LAYOUT_SINGLE: return "single";
+    case KERNEL_LAYOUT_INVALID: return "invalid";
+    default: abort();
+    }
+}
+
+} // namespace htio2
+
+std::string job_expression(JobType job)
+{
+    switch (job)
+    {
+    case JOB_TYPE_SINE: return "sin(x) + sin(2 * x) + sin(x * x) + sin(x + 0.5)";
+    case JOB_TYPE_TANGENT: return "tan(x) + tan(2 * x) + tan(x * x) + tan(x + 0.5)";
+    case JOB_TYPE_MIXED: return "tan(x) + tan(2 * x) + sin(x * x) + cos(x + 0.5)";
+    default: abort();
+    }
+}
+
+// x of sample idx, from the input buffer or from the program's generator
+template<typename T>
+static std::string load_input(const std::string& idx, bool gen_input)
+{
+    return gen_input ? "gen_input(" + idx + ")" : StorageTraits<T>::load(idx);
+}
+
+// what a kernel calculates from x: statements declaring temporaries, then
+// the value stored into each output buffer, "out", "out1", "out2" ...
+struct KernelCalc
+{
+    std::string expr;                 // the single output
+    const FusedExpr* fused = nullptr; // one output per formula instead of expr
+
+    size_t num_output() const { return fused ? fused->get_num_formula() : 1; }
+
+    std::string statements(const std::string& value_type, const std::string& indent) const
+    {
+        return fused ? fused->to_opencl(value_type, indent) : "";
+    }
+
+    std::string value(size_t i) const { return fused ? fused->get_result(i) : expr; }
+
+    static std::string output(size_t i) { return i ? "out" + htio2::to_string(i) : "out"; }
+};
+
+// statements and stores of sample idx, x already loaded
+template<typename T>
+static std::string make_scalar_stores(const KernelCalc& calc, const std::string& indent)
+{
+    typedef StorageTraits<T> Traits;
+    std::string re = calc.statements(Traits::compute_type(), indent);
+    for (size_t i = 0; i < calc.num_output(); i++)
+        re += indent + Traits::store(calc.value(i), "idx", KernelCalc::output(i)) + ";\n";
+    return re;
+}
+
+template<typename T>
+static std::string make_vector_body(const KernelCalc& calc, int width, bool gen_input)
+{
+    typedef StorageTraits<T> Traits;
+    std::string w = htio2::to_string(width);
+    std::string suffix = Traits::vector_suffix() + w;
+
+    std::string load = "vload" + suffix + "(i, in)";
+    if (gen_input)
+    {
+        load = "(" + Traits::compute_type() + w + ")(";
+        for (int k = 0; k < width; k++)
+            load += (k ? ", " : "") + std::string("gen_input(i * ") + w + " + " + htio2::to_string(k) + ")";
+        load += ")";
+    }
+
+    std::string vector_stores = calc.statements(Traits::compute_type() + w, "       ");
+    for (size_t i = 0; i < calc.num_output(); i++)
+        vector_stores += "       vstore" + suffix + "(" + calc.value(i) + ", i, " + KernelCalc::output(i) + ");\n";
+
+    return
+        "    long tid = get_global_id(0);\n"
+        "    long stride = get_global_size(0);\n"
+        "    long num_vec = num_sample / " + w + ";\n"
+        "    for (long i = tid; i < num_vec; i += stride)\n"
+        "    {\n"
+        "       " + Traits::compute_type() + w + " x = " + load + ";\n" +
+        vector_stores +
+        "    }\n"
+        "    for (long idx = num_vec * " + w + " + tid; idx < num_sample; idx += stride)\n"
+        "    {\n"
+        "       " + Traits::compute_type() + " x = " + load_input<T>("idx", gen_input) + ";\n" +
+        make_scalar_stores<T>(calc, "       ") +
+        "    }\n";
+}
+
+template<typename T>
+static std::string make_typed_source(const KernelCalc& calc, KernelLayout layout, const std::string& kernel_name,
+                                     bool gen_input)
+{
+    typedef StorageTraits<T> Traits;
+    std::string load = "       " + Traits::compute_type() + " x = " + load_input<T>("idx", gen_input) + ";\n";
+    std::string store = make_scalar_stores<T>(calc, "       ");
+
+    std::string body;
+    switch (layout)
+    {
+    case KERNEL_LAYOUT_CHUNKED:
+        body =
+            "    long tid = get_global_id(0);\n"
+            "    for (long i = 0; i < chunk_size; i++)\n"
+            "    {\n"
+            "       long idx = tid * chunk_size + i;\n"
+            "       if (idx >= num_sample) break;\n" +
+            load + store +
+            "    }\n";
+        break;
+    case KERNEL_LAYOUT_INTERLEAVED:
+        body =
+            "    long stride = get_global_size(0);\n"
+            "    for (long idx = get_global_id(0); idx < num_sample; idx += stride)\n"
+            "    {\n" +
+            load + store +
+            "    }\n";
+        break;
+    case KERNEL_LAYOUT_VEC4:
+        body = make_vector_body<T>(calc, 4, gen_input);
+        break;
+    case KERNEL_LAYOUT_VEC8:
+        body = make_vector_body<T>(calc, 8, gen_input);
+        break;
+    case KERNEL_LAYOUT_SINGLE:
+        body =
+            "    long idx = get_global_id(0);\n"
+            "    if (idx >= num_sample) return;\n"
+            "    " + Traits::compute_type() + " x = " + load_input<T>("idx", gen_input) + ";\n" +
+            make_scalar_stores<T>(calc, "    ");
+        break;
+    default:
+        abort();
+    }
+
+    // further outputs go after the range arguments, so those keep their index
+    std::string extra_outputs;
+    for (size_t i = 1; i < calc.num_output(); i++)
+        extra_outputs += ",\n    __global " + Traits::buffer_type() + "* " + KernelCalc::output(i);
+
+    return
+        Traits::pragma() +
+        "__kernel void " + kernel_name + "(__global " + Traits::buffer_type() + "* in,\n"
+        "    __global " + Traits::buffer_type() + "* out,\n"
+        "    long num_sample,\n"
+        "    long chunk_size" + extra_outputs + ")\n"
+        "{\n" + body + "}\n";
+}
+
+std::string make_kernel_source(const std::string& expr, KernelLayout layout, const std::string& kernel_name,
+                               StorageType storage, bool gen_input)
+{
+    KernelCalc calc;
+    calc.expr = expr;
+    switch (storage)
+    {
+    case STORAGE_FP32: return make_typed_source<cl_float>(calc, layout, kernel_name, gen_input);
+    case STORAGE_FP16: return make_typed_source<cl_half>(calc, layout, kernel_name, gen_input);
+    case STORAGE_FP64: return make_typed_source<cl_double>(calc, layout, kernel_name, gen_input);
+    default: abort();
+    }
+}
+
+std::string make_fused_kernel_source(const FusedExpr& fused, KernelLayout layout, const std::string& kernel_name)
+{
+    KernelCalc calc;
+    calc.fused = &fused;
+    return make_typed_source<cl_float>(calc, layout, kernel_name, false);
+}
+
+size_t get_global_size(KernelLayout layout, size_t num_sample, size_t max_global, size_t local_size)
+{
+    size_t re = (layout == KERNEL_LAYOUT_SINGLE) ? num_sample : max_global;
+    if (local_size)
+        re = (re + local_size - 1) / local_size * local_size;
+    return re;
+}
@@ -0,0 +1,74 @@
+#ifndef MY_KERNEL_SOURCE_H
+#define MY_KERNEL_SOURCE_H
+
+#include <string>
+
+#include "utils.h"
+
+class FusedExpr;
+
+typedef enum {
+    KERNEL_LAYOUT_CHUNKED = 0,     // work-item i handles [i*chunk_size, (i+1)*chunk_size)
+    KERNEL_LAYOUT_INTERLEAVED = 1, // grid-stride loop, adjacent work-items touch adjacent samples
+    KERNEL_LAYOUT_VEC4 = 2,        // grid-stride loop over float4 loads and stores
+    KERNEL_LAYOUT_VEC8 = 3,        // grid-stride loop over float8 loads and stores
+    KERNEL_LAYOUT_SINGLE = 4,      // one sample per work-item, global size covers all samples
+    KERNEL_LAYOUT_INVALID = 255,
+} KernelLayout;
+
+namespace htio2
+{
+template<>
+bool from_string<KernelLayout>(const std::string& input, KernelLayout& result);
+
+template<>
+std::string to_string<KernelLayout>(KernelLayout input);
+
+} // namespace htio2
+
+///
+/// \brief formula of a job over the input sample "x", see Expr for the syntax
+///
+std::string job_expression(JobType job);
+
+///
+/// \brief source of a kernel that calculates OpenCL C expression expr over
+/// each input sample "x"
+///
+/// All layouts share the signature, under the given kernel name:
+///   <kernel_name>(__global float* in, __global float* out, long num_sample, long chunk_size)
+/// Indices are 64-bit, chunk_size is only used by the chunked layout. Sources
+/// with distinct kernel names can be concatenated into one program. The
+/// buffers hold the storage type instead of float, see StorageTraits: fp16 is
+/// converted through vload_half and vstore_half and calculated in float, fp64
+/// is calculated in double and enables cl_khr_fp64.
+///
+/// With gen_input, x is "gen_input(idx)" instead of a load from in, and the
+/// program must define that function before the kernel, see make_input_source().
+///
+std::string make_kernel_source(const std::string& expr, KernelLayout layout,
+                               const std::string& kernel_name = "hello",
+                               StorageType storage = STORAGE_FP32,
+                               bool gen_input = false);
+
+///
+/// \brief source of a kernel that reads each sample once and stores every
+/// formula of fused into its own float buffer
+///
+/// Arguments 0 to 3 are those of make_kernel_source() with formula 0 going to
+/// out, formula i > 0 goes to argument 3 + i:
+///   fused(__global float* in, __global float* out, long num_sample, long chunk_size,
+///         __global float* out1, __global float* out2, ...)
+///
+std::string make_fused_kernel_source(const FusedExpr& fused, KernelLayout layout,
+                                     const std::string& kernel_name = "fused");
+
+///
+/// \brief global work size of a layout
+///
+/// \param max_global  global size of the grid-stride layouts
+/// \param local_size  work-group size, 0 if left to the runtime
+///
+size_t get_global_size(KernelLayout layout, size_t num_sample, size_t max_global, size_t local_size);
+
+#endif // MY_KERNEL_SOURCE_H
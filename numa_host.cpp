@@ -0,0 +1,255 @@
+#include "numa_host.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// device queries of the PCI extensions, in case the headers predate them
+#ifndef CL_DEVICE_PCI_BUS_INFO_KHR
+#define CL_DEVICE_PCI_BUS_INFO_KHR 0x410F
+#endif
+#ifndef CL_DEVICE_TOPOLOGY_AMD
+#define CL_DEVICE_TOPOLOGY_AMD 0x4037
+#endif
+#ifndef CL_DEVICE_PCI_BUS_ID_NV
+#define CL_DEVICE_PCI_BUS_ID_NV 0x4008
+#endif
+#ifndef CL_DEVICE_PCI_SLOT_ID_NV
+#define CL_DEVICE_PCI_SLOT_ID_NV 0x4009
+#endif
+#ifndef CL_DEVICE_PCI_DOMAIN_ID_NV
+#define CL_DEVICE_PCI_DOMAIN_ID_NV 0x400A
+#endif
+
+namespace htio2
+{
+template<>
+bool from_string<NumaPolicy>(const std::string& input, NumaPolicy& result)
+{
+    if (input == "none") result = NUMA_POLICY_NONE;
+    else if (input == "firsttouch") result = NUMA_POLICY_FIRST_TOUCH;
+    else if (input == "mbind") result = NUMA_POLICY_MBIND;
+    else return false;
+    return true;
+}
+
+template<>
+std::string to_string<NumaPolicy>(NumaPolicy input)
+{
+    switch (input)
+    {
+    case NUMA_POLICY_NONE: return "none";
+    case NUMA_POLICY_FIRST_TOUCH: return "firsttouch";
+    case NUMA_POLICY_MBIND: return "mbind";
+    case NUMA_POLICY_INVALID: return "invalid";
+    default: abort();
+    }
+}
+
+} // namespace htio2
+
+static bool read_text_file(const std::string& file, std::string& content)
+{
+    FILE* fh = fopen(file.c_str(), "r");
+    if (!fh) return false;
+    char buf[4096];
+    size_t n = fread(buf, 1, sizeof(buf) - 1, fh);
+    fclose(fh);
+    content.assign(buf, n);
+    return true;
+}
+
+int get_num_numa_nodes()
+{
+    int re = 0;
+#ifdef __linux__
+    // node directories are numbered without gaps on all but hotplug systems,
+    // count up to the first missing one
+    for (;;)
+    {
+        char path[64];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d", re);
+        DIR* dir = opendir(path);
+        if (!dir) break;
+        closedir(dir);
+        re++;
+    }
+#endif
+    return re ? re : 1;
+}
+
+bool get_numa_node_cpus(int node, std::vector<int>& cpus)
+{
+    cpus.clear();
+    char path[80];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    std::string text;
+    if (!read_text_file(path, text)) return false;
+
+    // comma separated CPUs and ranges, like "0-7,16-23"
+    const char* p = text.c_str();
+    while (*p)
+    {
+        char* end = nullptr;
+        long first = strtol(p, &end, 10);
+        if (end == p) break;
+        long last = first;
+        p = end;
+        if (*p == '-')
+        {
+            last = strtol(p + 1, &end, 10);
+            p = end;
+        }
+        for (long cpu = first; cpu <= last; cpu++)
+            cpus.push_back(int(cpu));
+        if (*p == ',') p++;
+    }
+    return true;
+}
+
+static std::string format_pci_address(unsigned domain, unsigned bus, unsigned device, unsigned function)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%04x:%02x:%02x.%x", domain, bus, device, function);
+    return buf;
+}
+
+std::string get_dev_pci_address(cl_device_id dev)
+{
+    size_t ext_size = 0;
+    clGetDeviceInfo(dev, CL_DEVICE_EXTENSIONS, 0, nullptr, &ext_size);
+    std::string ext(ext_size, '\0');
+    if (ext_size) clGetDeviceInfo(dev, CL_DEVICE_EXTENSIONS, ext_size, &ext[0], nullptr);
+
+    if (ext.find("cl_khr_pci_bus_info") != std::string::npos)
+    {
+        cl_uint info[4] = {0, 0, 0, 0}; // domain, bus, device, function
+        if (clGetDeviceInfo(dev, CL_DEVICE_PCI_BUS_INFO_KHR, sizeof(info), info, nullptr) == CL_SUCCESS)
+            return format_pci_address(info[0], info[1], info[2], info[3]);
+    }
+
+    if (ext.find("cl_amd_device_attribute_query") != std::string::npos)
+    {
+        // cl_device_topology_amd: type 1 is PCIe, bus, device and function are
+        // the last three bytes of its 24
+        unsigned char topology[24];
+        memset(topology, 0, sizeof(topology));
+        if (clGetDeviceInfo(dev, CL_DEVICE_TOPOLOGY_AMD, sizeof(topology), topology, nullptr) == CL_SUCCESS)
+        {
+            cl_uint type = 0;
+            memcpy(&type, topology, sizeof(type));
+            if (type == 1)
+                return format_pci_address(0, topology[21], topology[22], topology[23]);
+        }
+    }
+
+    if (ext.find("cl_nv_device_attribute_query") != std::string::npos)
+    {
+        // the slot holds device << 3 | function, the domain query is newer than the others
+        cl_uint bus = 0, slot = 0, domain = 0;
+        if (clGetDeviceInfo(dev, CL_DEVICE_PCI_BUS_ID_NV, sizeof(bus), &bus, nullptr) == CL_SUCCESS &&
+            clGetDeviceInfo(dev, CL_DEVICE_PCI_SLOT_ID_NV, sizeof(slot), &slot, nullptr) == CL_SUCCESS)
+        {
+            if (clGetDeviceInfo(dev, CL_DEVICE_PCI_DOMAIN_ID_NV, sizeof(domain), &domain, nullptr) != CL_SUCCESS)
+                domain = 0;
+            return format_pci_address(domain, bus, slot >> 3, slot & 7);
+        }
+    }
+
+    return std::string();
+}
+
+int get_pci_numa_node(const std::string& address)
+{
+    if (address.empty()) return -1;
+    std::string text;
+    if (!read_text_file("/sys/bus/pci/devices/" + address + "/numa_node", text)) return -1;
+    return atoi(text.c_str()); // -1 when the firmware does not tell
+}
+
+#ifdef __linux__
+
+bool pin_thread_to_numa_node(int node, std::string& error)
+{
+    std::vector<int> cpus;
+    if (!get_numa_node_cpus(node, cpus) || cpus.empty())
+    {
+        // without NUMA in sysfs, node 0 is the whole machine
+        if (node == 0 && get_num_numa_nodes() == 1) return true;
+        error = "no CPUs listed for node " + htio2::to_string(node);
+        return false;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (size_t i = 0; i < cpus.size(); i++)
+        CPU_SET(cpus[i], &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0)
+    {
+        error = std::string("sched_setaffinity failed: ") + strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+bool bind_numa_memory(void* ptr, size_t size, int node, std::string& error)
+{
+    // maxnode counts one bit more than the mask holds, the kernel drops the last
+    const size_t mask_bits = 1024;
+    unsigned long mask[mask_bits / (8 * sizeof(unsigned long))];
+    memset(mask, 0, sizeof(mask));
+    if (node < 0 || size_t(node) >= mask_bits)
+    {
+        error = "invalid node " + htio2::to_string(node);
+        return false;
+    }
+    mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+
+    if (syscall(__NR_mbind, ptr, size, MPOL_BIND, mask, mask_bits + 1, MPOL_MF_MOVE | MPOL_MF_STRICT) != 0)
+    {
+        error = std::string("mbind failed: ") + strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+int get_page_numa_node(const void* ptr)
+{
+    // move_pages without target nodes only reports where the pages are
+    long page = sysconf(_SC_PAGESIZE);
+    void* pages[1] = {(void*) ((size_t) ptr / page * page)};
+    int status[1] = {-1};
+    if (syscall(__NR_move_pages, 0, 1, pages, nullptr, status, 0) != 0) return -1;
+    return status[0] >= 0 ? status[0] : -1;
+}
+
+#else
+
+bool pin_thread_to_numa_node(int node, std::string& error)
+{
+    if (node == 0) return true;
+    error = "NUMA placement is only supported on Linux";
+    return false;
+}
+
+bool bind_numa_memory(void*, size_t, int, std::string& error)
+{
+    error = "NUMA placement is only supported on Linux";
+    return false;
+}
+
+int get_page_numa_node(const void*)
+{
+    return -1;
+}
+
+#endif
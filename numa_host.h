@@ -0,0 +1,73 @@
+#ifndef MY_NUMA_HOST_H
+#define MY_NUMA_HOST_H
+
+#include <CL/cl.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "htio2/Cast.h"
+
+typedef enum {
+    NUMA_POLICY_NONE = 0,        // wherever the kernel puts the pages, thread not pinned
+    NUMA_POLICY_FIRST_TOUCH = 1, // pin the thread, then touch the pages from it
+    NUMA_POLICY_MBIND = 2,       // bind the pages to the node with mbind, and pin the thread
+    NUMA_POLICY_INVALID = 255,
+} NumaPolicy;
+
+namespace htio2
+{
+template<>
+bool from_string<NumaPolicy>(const std::string& input, NumaPolicy& result);
+
+template<>
+std::string to_string<NumaPolicy>(NumaPolicy input);
+
+} // namespace htio2
+
+//
+// NUMA topology comes from /sys/devices/system/node, and memory policy and
+// page queries go through the raw mbind and move_pages system calls, so
+// nothing depends on libnuma. On other systems, or without NUMA in sysfs,
+// there is a single node 0 and binding fails.
+//
+
+///
+/// \brief number of NUMA nodes, 1 when sysfs shows none
+///
+int get_num_numa_nodes();
+
+///
+/// \brief CPUs of a node, from its cpulist; empty for memory-only nodes
+///
+bool get_numa_node_cpus(int node, std::vector<int>& cpus);
+
+///
+/// \brief PCI address "dddd:bb:dd.f" of an OpenCL device, empty if the platform
+/// exposes none of cl_khr_pci_bus_info, cl_amd_device_attribute_query or
+/// cl_nv_device_attribute_query
+///
+std::string get_dev_pci_address(cl_device_id dev);
+
+///
+/// \brief node of the PCIe root a device hangs off, -1 if sysfs does not tell
+///
+int get_pci_numa_node(const std::string& address);
+
+///
+/// \brief restrict the calling thread to the CPUs of a node
+///
+bool pin_thread_to_numa_node(int node, std::string& error);
+
+///
+/// \brief bind pages [ptr, ptr + size) to a node, moving those already present
+/// \param ptr must be page aligned
+///
+bool bind_numa_memory(void* ptr, size_t size, int node, std::string& error);
+
+///
+/// \brief node of the page holding ptr, -1 if unknown or not faulted in yet
+///
+int get_page_numa_node(const void* ptr);
+
+#endif // MY_NUMA_HOST_H
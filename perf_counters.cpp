@@ -0,0 +1,230 @@
+#include "perf_counters.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+PerfCounters::~PerfCounters()
+{
+#ifdef __linux__
+    for (int i = 0; i < NUM_PERF_COUNTER; i++)
+    {
+        for (size_t j = 0; j < fds[i].size(); j++)
+            close(fds[i][j]);
+    }
+#endif
+}
+
+const char* PerfCounters::get_name(Counter counter)
+{
+    switch (counter)
+    {
+    case PERF_CYCLES: return "cycles";
+    case PERF_INSTRUCTIONS: return "instructions";
+    case PERF_LLC_MISSES: return "llc_misses";
+    case PERF_DTLB_MISSES: return "dtlb_misses";
+    case PERF_PAGE_FAULTS: return "page_faults";
+    default: abort();
+    }
+}
+
+std::string PerfCounters::get_available_names() const
+{
+    std::string re;
+    for (int i = 0; i < NUM_PERF_COUNTER; i++)
+    {
+        if (!is_available(Counter(i))) continue;
+        if (re.length()) re += ",";
+        re += get_name(Counter(i));
+    }
+    return re;
+}
+
+#ifdef __linux__
+
+static void set_event(PerfCounters::Counter counter, perf_event_attr& attr)
+{
+    switch (counter)
+    {
+    case PerfCounters::PERF_CYCLES:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+    case PerfCounters::PERF_INSTRUCTIONS:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+    case PerfCounters::PERF_LLC_MISSES:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        break;
+    case PerfCounters::PERF_DTLB_MISSES:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                      (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+    case PerfCounters::PERF_PAGE_FAULTS:
+        attr.type = PERF_TYPE_SOFTWARE;
+        attr.config = PERF_COUNT_SW_PAGE_FAULTS;
+        break;
+    default:
+        abort();
+    }
+}
+
+static int open_event(PerfCounters::Counter counter, pid_t tid, bool exclude_kernel)
+{
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    set_event(counter, attr);
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.exclude_kernel = exclude_kernel;
+    attr.exclude_hv = 1;
+    return int(syscall(__NR_perf_event_open, &attr, tid, -1, -1, PERF_FLAG_FD_CLOEXEC));
+}
+
+static std::vector<pid_t> list_threads()
+{
+    std::vector<pid_t> re;
+    DIR* dir = opendir("/proc/self/task");
+    if (!dir) return re;
+    while (dirent* entry = readdir(dir))
+    {
+        if (entry->d_name[0] == '.') continue;
+        re.push_back(pid_t(atoi(entry->d_name)));
+    }
+    closedir(dir);
+    return re;
+}
+
+bool PerfCounters::open(std::string& error)
+{
+    std::vector<pid_t> threads = list_threads();
+    if (threads.empty())
+    {
+        error = "failed to list threads in /proc/self/task";
+        return false;
+    }
+
+    // kernel-side counts need perf_event_paranoid <= 1, all counters go
+    // without them when a software counter is refused them
+    int probe = open_event(PERF_PAGE_FAULTS, threads[0], false);
+    kernel_counted = probe >= 0;
+    if (probe >= 0) close(probe);
+
+    int last_errno = 0;
+    for (int i = 0; i < NUM_PERF_COUNTER; i++)
+    {
+        Counter counter = Counter(i);
+        for (size_t j = 0; j < threads.size(); j++)
+        {
+            int fd = open_event(counter, threads[j], !kernel_counted);
+            if (fd < 0)
+            {
+                last_errno = errno;
+                break;
+            }
+            fds[i].push_back(fd);
+        }
+
+        // a counter covers all threads or none of them
+        if (fds[i].size() < threads.size())
+        {
+            for (size_t j = 0; j < fds[i].size(); j++)
+                close(fds[i][j]);
+            fds[i].clear();
+        }
+    }
+
+    if (get_available_names().empty())
+    {
+        error = std::string("perf_event_open failed: ") + strerror(last_errno);
+        return false;
+    }
+    return true;
+}
+
+PerfCounters::Values PerfCounters::read() const
+{
+    Values re;
+    for (int i = 0; i < NUM_PERF_COUNTER; i++)
+    {
+        for (size_t j = 0; j < fds[i].size(); j++)
+        {
+            // value, time enabled, time running
+            uint64_t buf[3] = {0, 0, 0};
+            if (::read(fds[i][j], buf, sizeof(buf)) != ssize_t(sizeof(buf))) continue;
+            double scale = buf[2] ? double(buf[1]) / double(buf[2]) : 1.0;
+            re.value[i] += double(buf[0]) * scale;
+        }
+    }
+    return re;
+}
+
+#else
+
+bool PerfCounters::open(std::string& error)
+{
+    error = "perf_event_open is only available on Linux";
+    return false;
+}
+
+PerfCounters::Values PerfCounters::read() const
+{
+    return Values();
+}
+
+#endif
+
+PerfCounters::PhaseTotal& PerfCounters::get_phase(const std::string& phase)
+{
+    for (size_t i = 0; i < phases.size(); i++)
+    {
+        if (phases[i].first == phase)
+            return phases[i].second;
+    }
+    phases.push_back(std::make_pair(phase, PhaseTotal()));
+    return phases.back().second;
+}
+
+void PerfCounters::lap(const std::string& phase, double bytes, Values& mark)
+{
+    Values now = read();
+    PhaseTotal& total = get_phase(phase);
+    total.count++;
+    total.bytes += bytes;
+    for (int i = 0; i < NUM_PERF_COUNTER; i++)
+        total.sum.value[i] += now.value[i] - mark.value[i];
+    mark = now;
+}
+
+void PerfCounters::add_to_report(BenchReport& report) const
+{
+    for (size_t i = 0; i < phases.size(); i++)
+    {
+        const std::string prefix = "perf." + phases[i].first + ".";
+        const PhaseTotal& total = phases[i].second;
+        for (int k = 0; k < NUM_PERF_COUNTER; k++)
+        {
+            if (is_available(Counter(k)))
+                report.add_metric(prefix + get_name(Counter(k)), total.sum.value[k] / total.count);
+        }
+
+        double cycles = total.sum.value[PERF_CYCLES];
+        if (!is_available(PERF_CYCLES) || cycles <= 0.0) continue;
+        if (is_available(PERF_INSTRUCTIONS))
+            report.add_metric(prefix + "ipc", total.sum.value[PERF_INSTRUCTIONS] / cycles);
+        if (total.bytes > 0.0)
+            report.add_metric(prefix + "bytes_per_cycle", total.bytes / cycles);
+    }
+}
@@ -0,0 +1,104 @@
+#ifndef MY_PERF_COUNTERS_H
+#define MY_PERF_COUNTERS_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "bench_report.h"
+
+///
+/// \brief hardware and kernel counters of host phases, through Linux perf_event_open
+///
+/// Counters are opened on every thread of the process that is running when
+/// open() is called, and read as the sum over those threads, so the workers of
+/// a host thread pool created before are included, and threads started later,
+/// like those of an OpenCL runtime, are not. Each counter is a separate event
+/// scaled by its enabled and running times, so counters the PMU has to
+/// multiplex are estimates. Counters the kernel refuses, as on a virtual
+/// machine without PMU or under a strict perf_event_paranoid, are left out.
+///
+/// Reading costs one system call per counter and thread, which lands in the
+/// wall time of whatever phase is measured around it.
+///
+class PerfCounters
+{
+public:
+    enum Counter
+    {
+        PERF_CYCLES,
+        PERF_INSTRUCTIONS,
+        PERF_LLC_MISSES,  // last level cache misses of loads and stores
+        PERF_DTLB_MISSES, // data TLB misses of loads
+        PERF_PAGE_FAULTS,
+        NUM_PERF_COUNTER,
+    };
+
+    struct Values
+    {
+        double value[NUM_PERF_COUNTER] = {};
+    };
+
+public:
+    PerfCounters() {}
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters& other) = delete;
+    PerfCounters& operator = (const PerfCounters& other) = delete;
+
+    ///
+    /// \brief open every counter on every current thread
+    /// \return false with the reason in error if no counter could be opened
+    ///
+    bool open(std::string& error);
+
+    bool is_available(Counter counter) const { return !fds[counter].empty(); }
+
+    ///
+    /// \brief whether the counters include time spent in the kernel on behalf
+    /// of the threads, which perf_event_paranoid may forbid
+    ///
+    bool is_kernel_counted() const { return kernel_counted; }
+
+    ///
+    /// \brief names of the available counters, comma separated
+    ///
+    std::string get_available_names() const;
+
+    static const char* get_name(Counter counter);
+
+    ///
+    /// \brief current totals over all threads
+    ///
+    Values read() const;
+
+    ///
+    /// \brief add the counts since mark to phase, and move mark to now
+    /// \param bytes bytes the phase moved, 0 if not meaningful
+    ///
+    void lap(const std::string& phase, double bytes, Values& mark);
+
+    ///
+    /// \brief add metrics "perf.<phase>.<counter>" per call, "perf.<phase>.ipc"
+    /// and "perf.<phase>.bytes_per_cycle" of every phase
+    ///
+    void add_to_report(BenchReport& report) const;
+
+    void clear_phases() { phases.clear(); }
+
+protected:
+    struct PhaseTotal
+    {
+        size_t count = 0;
+        double bytes = 0.0;
+        Values sum;
+    };
+
+    PhaseTotal& get_phase(const std::string& phase);
+
+    std::vector<int> fds[NUM_PERF_COUNTER];
+    bool kernel_counted = true;
+    std::vector<std::pair<std::string, PhaseTotal> > phases;
+};
+
+#endif // MY_PERF_COUNTERS_H
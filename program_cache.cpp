@@ -0,0 +1,197 @@
+#include "program_cache.h"
+#include "utils.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <direct.h>
+#include <process.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char CACHE_MAGIC[] = "cltoy program binary v2\n";
+
+static std::string get_platform_version(cl_device_id dev)
+{
+    cl_platform_id plat = nullptr;
+    clGetDeviceInfo(dev, CL_DEVICE_PLATFORM, sizeof(plat), &plat, nullptr);
+
+    char version[256] = {0};
+    clGetPlatformInfo(plat, CL_PLATFORM_VERSION, sizeof(version) - 1, version, nullptr);
+    return version;
+}
+
+// full description of everything the binary depends on, the source itself
+// included; stored in the file and compared on load, so a collision of the
+// file name hash can not load a wrong binary
+static std::string make_cache_key(cl_device_id dev, const std::string& src, const std::string& options)
+{
+    return "source " + htio2::to_string(src.size()) + "\n" + src + "\n" +
+           "options " + options + "\n" +
+           "device " + get_dev_info_string(dev, CL_DEVICE_NAME) + "\n" +
+           "device_version " + get_dev_info_string(dev, CL_DEVICE_VERSION) + "\n" +
+           "driver " + get_dev_info_string(dev, CL_DRIVER_VERSION) + "\n" +
+           "platform " + get_platform_version(dev) + "\n";
+}
+
+static bool read_cached_binary(const std::string& file, const std::string& key, std::vector<unsigned char>& binary)
+{
+    FILE* fh = fopen(file.c_str(), "rb");
+    if (!fh) return false;
+
+    std::string header = std::string(CACHE_MAGIC) + key;
+    std::vector<char> stored(header.size());
+    bool ok = fread(&stored[0], 1, stored.size(), fh) == stored.size() &&
+              std::string(stored.begin(), stored.end()) == header;
+
+    if (ok)
+    {
+        binary.clear();
+        unsigned char buf[65536];
+        size_t n = 0;
+        while ((n = fread(buf, 1, sizeof(buf), fh)) > 0)
+            binary.insert(binary.end(), buf, buf + n);
+        ok = !binary.empty();
+    }
+
+    fclose(fh);
+    return ok;
+}
+
+static void write_cached_binary(const std::string& file, const std::string& key, cl_program prog)
+{
+    size_t binary_size = 0;
+    if (clGetProgramInfo(prog, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &binary_size, nullptr) != CL_SUCCESS ||
+        binary_size == 0)
+    {
+        fprintf(stderr, "program binary is not available, not cached\n");
+        return;
+    }
+
+    std::vector<unsigned char> binary(binary_size);
+    unsigned char* binary_ptr = &binary[0];
+    if (clGetProgramInfo(prog, CL_PROGRAM_BINARIES, sizeof(binary_ptr), &binary_ptr, nullptr) != CL_SUCCESS)
+    {
+        fprintf(stderr, "failed to get program binary, not cached\n");
+        return;
+    }
+
+    // write aside and rename, so that a concurrent reader never sees half a
+    // file; the name is per process, so concurrent writers do not share it
+#ifdef _MSC_VER
+    std::string tmp_file = file + "." + htio2::to_string(_getpid()) + ".tmp";
+#else
+    std::string tmp_file = file + "." + htio2::to_string(getpid()) + ".tmp";
+#endif
+    FILE* fh = fopen(tmp_file.c_str(), "wb");
+    if (!fh)
+    {
+        fprintf(stderr, "failed to write program binary cache %s\n", tmp_file.c_str());
+        return;
+    }
+    fwrite(CACHE_MAGIC, 1, sizeof(CACHE_MAGIC) - 1, fh);
+    fwrite(key.data(), 1, key.size(), fh);
+    fwrite(&binary[0], 1, binary.size(), fh);
+    fclose(fh);
+
+    // POSIX rename replaces the entry at once, Windows refuses an existing target
+#ifdef _MSC_VER
+    remove(file.c_str());
+#endif
+    if (rename(tmp_file.c_str(), file.c_str()) != 0)
+    {
+        fprintf(stderr, "failed to move program binary cache to %s\n", file.c_str());
+        remove(tmp_file.c_str());
+    }
+}
+
+static cl_program load_cached_program(cl_context context, cl_device_id dev,
+                                      const std::vector<unsigned char>& binary, const std::string& options)
+{
+    cl_int err = 0;
+    cl_int binary_status = 0;
+    size_t binary_size = binary.size();
+    const unsigned char* binary_ptr = &binary[0];
+    cl_program prog = clCreateProgramWithBinary(context, 1, &dev, &binary_size, &binary_ptr, &binary_status, &err);
+    if (err != CL_SUCCESS || binary_status != CL_SUCCESS)
+    {
+        fprintf(stderr, "cached program binary rejected: %d %d\n", err, binary_status);
+        if (prog) clReleaseProgram(prog);
+        return nullptr;
+    }
+
+    err = clBuildProgram(prog, 1, &dev, options.c_str(), nullptr, nullptr);
+    if (err != CL_SUCCESS)
+    {
+        fprintf(stderr, "failed to build cached program binary: %d\n", err);
+        clReleaseProgram(prog);
+        return nullptr;
+    }
+    return prog;
+}
+
+static void make_dir(const std::string& dir)
+{
+#ifdef _MSC_VER
+    _mkdir(dir.c_str());
+#else
+    mkdir(dir.c_str(), 0755);
+#endif
+}
+
+static char program_build_log[8192];
+
+cl_program build_program_cached(cl_context context, cl_device_id dev,
+                                const std::string& src, const std::string& options,
+                                const std::string& cache_dir, bool& cache_hit)
+{
+    cache_hit = false;
+    std::string key;
+    std::string file;
+
+    if (cache_dir.length())
+    {
+        key = make_cache_key(dev, src, options);
+        file = cache_dir + "/" + hash_to_hex(hash_fnv1a(key)) + ".clbin";
+
+        std::vector<unsigned char> binary;
+        if (read_cached_binary(file, key, binary))
+        {
+            cl_program prog = load_cached_program(context, dev, binary, options);
+            if (prog)
+            {
+                cache_hit = true;
+                return prog;
+            }
+        }
+    }
+
+    cl_int err = 0;
+    const char* src_ptr = src.c_str();
+    cl_program prog = clCreateProgramWithSource(context, 1, &src_ptr, nullptr, &err);
+    if (err != CL_SUCCESS)
+    {
+        printf("failed to create program with error: %d\n", err);
+        exit(1);
+    }
+
+    err = clBuildProgram(prog, 1, &dev, options.c_str(), nullptr, nullptr);
+    if (err != CL_SUCCESS)
+    {
+        printf("failed to build program: %d\n", err);
+        clGetProgramBuildInfo(prog, dev, CL_PROGRAM_BUILD_LOG, sizeof(program_build_log), program_build_log, nullptr);
+        printf("%s\n", program_build_log);
+        exit(1);
+    }
+
+    if (cache_dir.length())
+    {
+        make_dir(cache_dir);
+        write_cached_binary(file, key, prog);
+    }
+    return prog;
+}
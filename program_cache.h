@@ -0,0 +1,21 @@
+#ifndef MY_PROGRAM_CACHE_H
+#define MY_PROGRAM_CACHE_H
+
+#include <CL/cl.h>
+#include <string>
+
+///
+/// \brief build a program for one device, reusing a saved binary when possible
+///
+/// With a non-empty cache_dir, the binary is looked up by a key covering the
+/// source, build options, device, device version, driver and platform version.
+/// A missing, mismatched or rejected binary falls back to a source build whose
+/// binary is then saved. Exits on build failure, after printing the build log.
+///
+/// \param cache_hit set to true if the program came from a cached binary
+///
+cl_program build_program_cached(cl_context context, cl_device_id dev,
+                                 const std::string& src, const std::string& options,
+                                 const std::string& cache_dir, bool& cache_hit);
+
+#endif // MY_PROGRAM_CACHE_H
@@ -0,0 +1,100 @@
+#ifndef MY_STORAGE_TRAITS_H
+#define MY_STORAGE_TRAITS_H
+
+#include <CL/cl.h>
+#include <cstring>
+#include <string>
+
+#include "half_convert.h"
+#include "utils.h"
+
+///
+/// \brief everything that differs between element types of the device buffers
+///
+/// Host arrays are always float. An element type says how samples are
+/// converted into and out of its buffers, how the kernel declares, loads and
+/// stores them, and what value a float input keeps after the round trip, so
+/// code templated on the element type covers allocation, transfer, kernel
+/// source and validation at once.
+///
+/// cl_half is a 16-bit integer type on the host, so its specialization also
+/// answers for cl_ushort.
+///
+template<typename T>
+struct StorageTraits;
+
+template<>
+struct StorageTraits<cl_float>
+{
+    static StorageType storage() { return STORAGE_FP32; }
+
+    static std::string buffer_type() { return "float"; }
+    static std::string compute_type() { return "float"; }
+    static std::string pragma() { return ""; }
+
+    static std::string load(const std::string& idx) { return "in[" + idx + "]"; }
+    static std::string store(const std::string& value, const std::string& idx, const std::string& buf = "out")
+    {
+        return buf + "[" + idx + "] = " + value;
+    }
+    static std::string vector_suffix() { return ""; }
+
+    static void from_float(const float* in, cl_float* out, size_t n) { memcpy(out, in, n * sizeof(float)); }
+    static void to_float(const cl_float* in, float* out, size_t n) { memcpy(out, in, n * sizeof(float)); }
+    static float round(float value) { return value; }
+};
+
+template<>
+struct StorageTraits<cl_double>
+{
+    static StorageType storage() { return STORAGE_FP64; }
+
+    static std::string buffer_type() { return "double"; }
+    static std::string compute_type() { return "double"; }
+    static std::string pragma() { return "#pragma OPENCL EXTENSION cl_khr_fp64 : enable\n"; }
+
+    static std::string load(const std::string& idx) { return "in[" + idx + "]"; }
+    static std::string store(const std::string& value, const std::string& idx, const std::string& buf = "out")
+    {
+        return buf + "[" + idx + "] = " + value;
+    }
+    static std::string vector_suffix() { return ""; }
+
+    static void from_float(const float* in, cl_double* out, size_t n)
+    {
+        for (size_t i = 0; i < n; i++) out[i] = in[i];
+    }
+
+    // results are narrowed back into the float host arrays
+    static void to_float(const cl_double* in, float* out, size_t n)
+    {
+        for (size_t i = 0; i < n; i++) out[i] = float(in[i]);
+    }
+
+    static float round(float value) { return value; }
+};
+
+template<>
+struct StorageTraits<cl_half>
+{
+    static StorageType storage() { return STORAGE_FP16; }
+
+    // half pointers may be declared without cl_khr_fp16 as long as they are
+    // only accessed through vload_half and vstore_half
+    static std::string buffer_type() { return "half"; }
+    static std::string compute_type() { return "float"; }
+    static std::string pragma() { return ""; }
+
+    static std::string load(const std::string& idx) { return "vload_half(" + idx + ", in)"; }
+    static std::string store(const std::string& value, const std::string& idx, const std::string& buf = "out")
+    {
+        return "vstore_half(" + value + ", " + idx + ", " + buf + ")";
+    }
+    static std::string vector_suffix() { return "_half"; }
+
+    static void from_float(const float* in, cl_half* out, size_t n) { floats_to_halves(in, out, n); }
+    static void to_float(const cl_half* in, float* out, size_t n) { halves_to_floats(in, out, n); }
+    static float round(float value) { return half_to_float(float_to_half(value)); }
+};
+
+#endif // MY_STORAGE_TRAITS_H
@@ -0,0 +1,129 @@
+#include "thread_pool.h"
+
+#include <cstdio>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+size_t HostThreadPool::get_hardware_threads()
+{
+    size_t re = std::thread::hardware_concurrency();
+    return re ? re : 1;
+}
+
+HostThreadPool::HostThreadPool(size_t num_threads, bool pin_threads)
+    : queues(num_threads ? num_threads : get_hardware_threads())
+    , num_steals(0)
+{
+    for (size_t i = 0; i < queues.size(); i++)
+        threads.push_back(std::thread(&HostThreadPool::worker_main, this, i, pin_threads));
+}
+
+HostThreadPool::~HostThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    cond_start.notify_all();
+
+    for (size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+}
+
+void HostThreadPool::parallel_for(size_t n, size_t chunk_size, const RangeFunc& func)
+{
+    if (n == 0) return;
+    if (chunk_size == 0) chunk_size = n;
+
+    // give each worker a contiguous run of chunks, so that it walks memory in order
+    size_t num_chunk = (n + chunk_size - 1) / chunk_size;
+    size_t num_worker = queues.size();
+    for (size_t w = 0; w < num_worker; w++)
+    {
+        std::lock_guard<std::mutex> guard(queues[w].lock);
+        size_t i_begin = num_chunk * w / num_worker;
+        size_t i_end = num_chunk * (w + 1) / num_worker;
+        for (size_t i = i_begin; i < i_end; i++)
+        {
+            size_t begin = i * chunk_size;
+            size_t end = begin + chunk_size < n ? begin + chunk_size : n;
+            queues[w].chunks.push_back(std::make_pair(begin, end));
+        }
+    }
+
+    std::unique_lock<std::mutex> guard(lock);
+    job = &func;
+    num_working = num_worker;
+    generation++;
+    cond_start.notify_all();
+    cond_done.wait(guard, [this] { return num_working == 0; });
+    job = nullptr;
+}
+
+bool HostThreadPool::pop_own(size_t id, std::pair<size_t, size_t>& chunk)
+{
+    std::lock_guard<std::mutex> guard(queues[id].lock);
+    if (queues[id].chunks.empty()) return false;
+    chunk = queues[id].chunks.front();
+    queues[id].chunks.pop_front();
+    return true;
+}
+
+bool HostThreadPool::steal(size_t id, std::pair<size_t, size_t>& chunk)
+{
+    for (size_t offset = 1; offset < queues.size(); offset++)
+    {
+        WorkerQueue& victim = queues[(id + offset) % queues.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (victim.chunks.empty()) continue;
+        chunk = victim.chunks.back();
+        victim.chunks.pop_back();
+        num_steals++;
+        return true;
+    }
+    return false;
+}
+
+void HostThreadPool::worker_main(size_t id, bool pin)
+{
+#ifdef __linux__
+    if (pin)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(id % get_hardware_threads(), &cpus);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0)
+            fprintf(stderr, "failed to pin host worker %lu\n", (unsigned long) id);
+    }
+#else
+    (void) pin;
+#endif
+
+    unsigned long long seen = 0;
+    for (;;)
+    {
+        const RangeFunc* curr_job = nullptr;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            cond_start.wait(guard, [this, seen] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+            curr_job = job;
+        }
+
+        // chunks are only added before a job starts, so once both our own
+        // queue and all victims are empty, this worker is done
+        std::pair<size_t, size_t> chunk;
+        while (pop_own(id, chunk) || steal(id, chunk))
+            (*curr_job)(chunk.first, chunk.second);
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (--num_working == 0)
+                cond_done.notify_all();
+        }
+    }
+}
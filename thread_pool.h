@@ -0,0 +1,76 @@
+#ifndef MY_THREAD_POOL_H
+#define MY_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+///
+/// \brief fixed-size pool of host worker threads with work stealing
+///
+/// parallel_for() cuts a range into chunks and hands each worker a contiguous
+/// run of them. A worker takes chunks from the front of its own queue, and
+/// when that is empty it steals from the back of another worker's queue.
+///
+class HostThreadPool
+{
+public:
+    typedef std::function<void(size_t, size_t)> RangeFunc;
+
+    ///
+    /// \param num_threads number of workers, 0 for all hardware threads
+    /// \param pin_threads bind worker i to CPU i (Linux only)
+    ///
+    HostThreadPool(size_t num_threads, bool pin_threads);
+    ~HostThreadPool();
+
+    HostThreadPool(const HostThreadPool& other) = delete;
+    HostThreadPool& operator = (const HostThreadPool& other) = delete;
+
+    size_t get_num_threads() const { return threads.size(); }
+
+    ///
+    /// \brief number of chunks taken from another worker's queue, since creation
+    ///
+    size_t get_num_steals() const { return num_steals.load(); }
+
+    ///
+    /// \brief run func(begin, end) over [0, n) in chunks of chunk_size, and
+    /// block until all chunks are done
+    ///
+    void parallel_for(size_t n, size_t chunk_size, const RangeFunc& func);
+
+    static size_t get_hardware_threads();
+
+protected:
+    struct WorkerQueue
+    {
+        std::mutex lock;
+        std::deque<std::pair<size_t, size_t> > chunks;
+    };
+
+    void worker_main(size_t id, bool pin);
+    bool pop_own(size_t id, std::pair<size_t, size_t>& chunk);
+    bool steal(size_t id, std::pair<size_t, size_t>& chunk);
+
+    std::vector<std::thread> threads;
+    std::vector<WorkerQueue> queues;
+
+    std::mutex lock;
+    std::condition_variable cond_start;
+    std::condition_variable cond_done;
+    unsigned long long generation = 0;
+    size_t num_working = 0;
+    bool stopping = false;
+    const RangeFunc* job = nullptr;
+
+    std::atomic<size_t> num_steals;
+};
+
+#endif // MY_THREAD_POOL_H
@@ -0,0 +1,83 @@
+#include "tune_cache.h"
+#include "utils.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <vector>
+
+#include "htio2/StringUtil.h"
+
+TuneCache::TuneCache(const std::string& file)
+    : file(file)
+{
+}
+
+void TuneCache::load()
+{
+    std::ifstream fh(file.c_str());
+    std::string line;
+    while (std::getline(fh, line))
+    {
+        std::vector<std::string> fields;
+        htio2::split(line, '\t', fields);
+        if (fields.size() != 4) continue;
+
+        LaunchConfig config;
+        unsigned long global_size = 0;
+        unsigned long local_size = 0;
+        if (!htio2::from_string(fields[1], global_size) ||
+            !htio2::from_string(fields[2], local_size) ||
+            !htio2::from_string(fields[3], config.time_us) ||
+            global_size == 0)
+            continue;
+
+        config.global_size = global_size;
+        config.local_size = local_size;
+        entries[fields[0]] = config;
+    }
+}
+
+bool TuneCache::save() const
+{
+    FILE* fh = fopen(file.c_str(), "wb");
+    if (!fh)
+    {
+        fprintf(stderr, "failed to write tuning cache %s\n", file.c_str());
+        return false;
+    }
+
+    for (std::map<std::string, LaunchConfig>::const_iterator it = entries.begin(); it != entries.end(); it++)
+    {
+        fprintf(fh, "%s\t%lu\t%lu\t%.3f\n", it->first.c_str(),
+                (unsigned long) it->second.global_size, (unsigned long) it->second.local_size,
+                it->second.time_us);
+    }
+    fclose(fh);
+    return true;
+}
+
+bool TuneCache::lookup(const std::string& key, LaunchConfig& config) const
+{
+    std::map<std::string, LaunchConfig>::const_iterator it = entries.find(key);
+    if (it == entries.end()) return false;
+    config = it->second;
+    return true;
+}
+
+void TuneCache::store(const std::string& key, const LaunchConfig& config)
+{
+    entries[key] = config;
+}
+
+std::string TuneCache::make_key(const std::string& dev_name, const std::string& driver_version,
+                                const std::string& kernel_src, size_t num_sample)
+{
+    // the separator must not appear in the fields, and tabs end the key
+    std::string re = dev_name + "|" + driver_version + "|" + hash_to_hex(hash_fnv1a(kernel_src)) + "|" + htio2::to_string(num_sample);
+    for (size_t i = 0; i < re.size(); i++)
+    {
+        if (re[i] == '\t' || re[i] == '\n') re[i] = ' ';
+    }
+    return re;
+}
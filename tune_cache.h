@@ -0,0 +1,43 @@
+#ifndef MY_TUNE_CACHE_H
+#define MY_TUNE_CACHE_H
+
+#include <map>
+#include <string>
+
+struct LaunchConfig
+{
+    size_t global_size = 0;
+    size_t local_size  = 0; // 0 if left to the runtime
+    double time_us     = 0.0;
+};
+
+///
+/// \brief persistent store of tuned launch configurations
+///
+/// The file is plain text, one configuration per line:
+///   key <TAB> global_size <TAB> local_size <TAB> time_us
+/// Lines that fail to parse are ignored, so a damaged file only costs a re-tune.
+///
+class TuneCache
+{
+public:
+    TuneCache(const std::string& file);
+
+    void load();
+    bool save() const;
+
+    bool lookup(const std::string& key, LaunchConfig& config) const;
+    void store(const std::string& key, const LaunchConfig& config);
+
+    ///
+    /// \brief cache key of a kernel on a device at a problem size
+    ///
+    static std::string make_key(const std::string& dev_name, const std::string& driver_version,
+                                const std::string& kernel_src, size_t num_sample);
+
+protected:
+    std::string file;
+    std::map<std::string, LaunchConfig> entries;
+};
+
+#endif // MY_TUNE_CACHE_H
@@ -3,6 +3,10 @@
 #include <cstdio>
 #include <cstdlib>
 
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
 namespace htio2
 {
 template<>
@@ -11,6 +15,7 @@ bool from_string<BufferMode>(const std::string& input, BufferMode& result)
     if (input == "hostmap") result = BUFFER_MODE_HOST_MAP;
     else if (input == "devicemap") result = BUFFER_MODE_DEVICE_MAP;
     else if (input == "pinned") result = BUFFER_MODE_PINNED;
+    else if (input == "zerocopy") result = BUFFER_MODE_ZERO_COPY;
     else if (input == "dummy") result = BUFFER_MODE_DUMMY;
     else return false;
     return true;
@@ -35,6 +40,7 @@ std::string to_string<BufferMode>(BufferMode input)
     case BUFFER_MODE_HOST_MAP: return "hostmap";
     case BUFFER_MODE_DEVICE_MAP: return "devicemap";
     case BUFFER_MODE_PINNED: return "pinned";
+    case BUFFER_MODE_ZERO_COPY: return "zerocopy";
     case BUFFER_MODE_INVALID: return "invalid";
     default: abort();
     }
@@ -53,8 +59,42 @@ std::string to_string<JobType>(JobType input)
     }
 }
 
+template<>
+bool from_string<StorageType>(const std::string& input, StorageType& result)
+{
+    if (input == "fp32") result = STORAGE_FP32;
+    else if (input == "fp16") result = STORAGE_FP16;
+    else if (input == "fp64") result = STORAGE_FP64;
+    else return false;
+    return true;
+}
+
+template<>
+std::string to_string<StorageType>(StorageType input)
+{
+    switch (input)
+    {
+    case STORAGE_FP32: return "fp32";
+    case STORAGE_FP16: return "fp16";
+    case STORAGE_FP64: return "fp64";
+    case STORAGE_INVALID: return "invalid";
+    default: abort();
+    }
+}
+
 } // namespace htio2
 
+size_t get_storage_size(StorageType storage)
+{
+    switch (storage)
+    {
+    case STORAGE_FP32: return 4;
+    case STORAGE_FP16: return 2;
+    case STORAGE_FP64: return 8;
+    default: abort();
+    }
+}
+
 void show_all_platforms_and_devices()
 {
     cl_platform_id plats[256];
@@ -151,6 +191,51 @@ bool get_gpu_platform_and_device(cl_platform_id& plat, cl_device_id& dev)
     return false;
 }
 
+void get_all_platforms_and_devices(std::vector<cl_platform_id>& plats, std::vector<cl_device_id>& devs)
+{
+    plats.clear();
+    devs.clear();
+
+    // counts first, then the ids, so any number of them fits
+    cl_uint num_plat = 0;
+    {
+        cl_int re = clGetPlatformIDs(0, nullptr, &num_plat);
+        if (re != CL_SUCCESS)
+        {
+            fprintf(stderr, "failed to get platforms: error %d\n", re);
+            std::abort();
+        }
+    }
+    if (!num_plat) return;
+
+    std::vector<cl_platform_id> all_plats(num_plat);
+    {
+        cl_int re = clGetPlatformIDs(num_plat, &all_plats[0], nullptr);
+        if (re != CL_SUCCESS)
+        {
+            fprintf(stderr, "failed to get platforms: error %d\n", re);
+            std::abort();
+        }
+    }
+
+    for (cl_uint i_plat = 0; i_plat < num_plat; i_plat++)
+    {
+        cl_uint num_dev = 0;
+        if (clGetDeviceIDs(all_plats[i_plat], CL_DEVICE_TYPE_ALL, 0, nullptr, &num_dev) != CL_SUCCESS || !num_dev)
+            continue;
+
+        std::vector<cl_device_id> plat_devs(num_dev);
+        if (clGetDeviceIDs(all_plats[i_plat], CL_DEVICE_TYPE_ALL, num_dev, &plat_devs[0], nullptr) != CL_SUCCESS)
+            continue;
+
+        for (cl_uint i_dev = 0; i_dev < num_dev; i_dev++)
+        {
+            plats.push_back(all_plats[i_plat]);
+            devs.push_back(plat_devs[i_dev]);
+        }
+    }
+}
+
 
 void show_plat_info(cl_platform_id plat)
 {
@@ -195,3 +280,54 @@ void show_dev_info(cl_device_id dev, cl_uint& num_dim, size_t*& dim_sizes)
         printf("    %d: %lu\n", i+1, dim_sizes[i]);
     }
 }
+
+std::string get_dev_info_string(cl_device_id dev, cl_device_info key)
+{
+    size_t size = 0;
+    if (clGetDeviceInfo(dev, key, 0, nullptr, &size) != CL_SUCCESS || size == 0)
+        return std::string();
+
+    std::string re(size, '\0');
+    clGetDeviceInfo(dev, key, size, &re[0], nullptr);
+    re.resize(size - 1); // strip trailing NUL
+    return re;
+}
+
+void* aligned_host_alloc(size_t alignment, size_t size)
+{
+#ifdef _MSC_VER
+    return _aligned_malloc(size, alignment);
+#else
+    void* re = nullptr;
+    if (posix_memalign(&re, alignment, size) != 0)
+        return nullptr;
+    return re;
+#endif
+}
+
+void aligned_host_free(void* ptr)
+{
+#ifdef _MSC_VER
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+uint64_t hash_fnv1a(const std::string& data)
+{
+    uint64_t re = 14695981039346656037ULL;
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        re ^= (unsigned char) data[i];
+        re *= 1099511628211ULL;
+    }
+    return re;
+}
+
+std::string hash_to_hex(uint64_t hash)
+{
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016llx", (unsigned long long) hash);
+    return buf;
+}
@@ -2,7 +2,9 @@
 #define MY_UTILS_H
 
 #include <CL/cl.h>
+#include <stdint.h>
 #include <string>
+#include <vector>
 
 #include "htio2/Cast.h"
 
@@ -11,6 +13,7 @@ typedef enum {
     BUFFER_MODE_HOST_MAP = 1,
     BUFFER_MODE_DEVICE_MAP = 2,
     BUFFER_MODE_PINNED = 3,
+    BUFFER_MODE_ZERO_COPY = 4,
     BUFFER_MODE_INVALID = 255,
 } BufferMode;
 
@@ -21,6 +24,13 @@ typedef enum {
     JOB_TYPE_INVALID = 255,
 } JobType;
 
+typedef enum {
+    STORAGE_FP32 = 0,
+    STORAGE_FP16 = 1,   // half in device buffers and on the bus, float in kernels and host arrays
+    STORAGE_FP64 = 2,   // double in device buffers and kernels, needs cl_khr_fp64
+    STORAGE_INVALID = 255,
+} StorageType;
+
 namespace htio2
 {
 template<>
@@ -35,15 +45,47 @@ std::string to_string<BufferMode>(BufferMode input);
 template<>
 std::string to_string<JobType>(JobType input);
 
+template<>
+bool from_string<StorageType>(const std::string& input, StorageType& result);
+
+template<>
+std::string to_string<StorageType>(StorageType input);
+
 } // namespace htio2
 
 
+///
+/// \brief bytes of one sample in device buffers
+///
+size_t get_storage_size(StorageType storage);
+
 void show_all_platforms_and_devices();
 
 bool get_gpu_platform_and_device(cl_platform_id& plat, cl_device_id& dev);
 
+///
+/// \brief every device of every platform, of any type, devs[i] belongs to plats[i]
+///
+void get_all_platforms_and_devices(std::vector<cl_platform_id>& plats, std::vector<cl_device_id>& devs);
+
 void show_plat_info(cl_platform_id plat);
 
 void show_dev_info(cl_device_id dev, cl_uint& num_dim, size_t*& dim_sizes);
 
+std::string get_dev_info_string(cl_device_id dev, cl_device_info key);
+
+///
+/// \brief allocate host memory on an alignment boundary, free it with aligned_host_free()
+///
+void* aligned_host_alloc(size_t alignment, size_t size);
+
+void aligned_host_free(void* ptr);
+
+///
+/// \brief 64-bit FNV-1a hash, stable across runs and platforms, used for cache keys
+///
+uint64_t hash_fnv1a(const std::string& data);
+
+std::string hash_to_hex(uint64_t hash);
+
 #endif // MY_UTILS_H
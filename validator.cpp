@@ -0,0 +1,185 @@
+#include "validator.h"
+#include "expr.h"
+#include "thread_pool.h"
+#include "half_convert.h"
+#include "storage_traits.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+const double ErrorStats::ULP_BOUNDS[ErrorStats::NUM_ULP_BUCKET - 1] = {0, 1, 2, 4, 16, 256};
+const double ErrorStats::REL_BOUNDS[ErrorStats::NUM_REL_BUCKET - 1] = {1e-7, 1e-6, 1e-5, 1e-4, 1e-3};
+
+// samples per parallel task, the reference of a task stays within L2 cache
+static const size_t VALIDATE_CHUNK = 16384;
+
+// floats mapped to integers in the same order, adjacent floats differ by 1
+static inline int64_t float_order(float value)
+{
+    int32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits >= 0 ? int64_t(bits) : int64_t(INT32_MIN) - bits;
+}
+
+// the same for halves, results of fp16 storage are exact halves
+static inline int64_t half_order(float value)
+{
+    uint16_t bits = float_to_half(value);
+    return (bits & 0x8000) ? -int64_t(bits & 0x7fff) : int64_t(bits);
+}
+
+template<int N>
+static int find_bucket(const double (&bounds)[N], double value)
+{
+    for (int i = 0; i < N; i++)
+        if (value <= bounds[i]) return i;
+    return N;
+}
+
+void ErrorStats::add(int64_t index, float result, float expect, StorageType storage)
+{
+    count++;
+
+    if (std::isnan(result) || std::isnan(expect))
+    {
+        if (std::isnan(result) && std::isnan(expect))
+        {
+            ulp_hist[0]++;
+            rel_hist[0]++;
+        }
+        else
+        {
+            nan_mismatch++;
+        }
+        return;
+    }
+
+    int64_t diff = (storage == STORAGE_FP16) ? half_order(result) - half_order(expect)
+                            : float_order(result) - float_order(expect);
+    double ulp = double(diff < 0 ? -diff : diff);
+    double rel = (ulp == 0.0) ? 0.0 : std::fabs(double(result) - double(expect)) / std::max(std::fabs(double(expect)), double(FLT_MIN));
+
+    sum_ulp += ulp;
+    sum_rel += rel;
+    if (ulp > max_ulp || worst_index < 0)
+    {
+        max_ulp = ulp;
+        worst_index = index;
+    }
+    if (rel > max_rel) max_rel = rel;
+
+    ulp_hist[find_bucket(ULP_BOUNDS, ulp)]++;
+    rel_hist[find_bucket(REL_BOUNDS, rel)]++;
+}
+
+void ErrorStats::merge(const ErrorStats& other)
+{
+    if (other.max_ulp > max_ulp || (worst_index < 0 && other.worst_index >= 0))
+    {
+        max_ulp = other.max_ulp;
+        worst_index = other.worst_index;
+    }
+    if (other.max_rel > max_rel) max_rel = other.max_rel;
+
+    count += other.count;
+    nan_mismatch += other.nan_mismatch;
+    sum_ulp += other.sum_ulp;
+    sum_rel += other.sum_rel;
+    for (int i = 0; i < NUM_ULP_BUCKET; i++) ulp_hist[i] += other.ulp_hist[i];
+    for (int i = 0; i < NUM_REL_BUCKET; i++) rel_hist[i] += other.rel_hist[i];
+}
+
+void ErrorStats::add_to_report(BenchReport& report) const
+{
+    size_t num_finite = count - nan_mismatch;
+    report.add_metric("validate.checked", double(count));
+    report.add_metric("validate.nan_mismatch", double(nan_mismatch));
+    report.add_metric("validate.max_ulp", max_ulp);
+    report.add_metric("validate.mean_ulp", num_finite ? sum_ulp / num_finite : 0.0);
+    report.add_metric("validate.max_rel", max_rel);
+    report.add_metric("validate.mean_rel", num_finite ? sum_rel / num_finite : 0.0);
+    report.add_metric("validate.worst_index", double(worst_index));
+
+    char name[64];
+    for (int i = 0; i < NUM_ULP_BUCKET; i++)
+    {
+        if (i < NUM_ULP_BUCKET - 1)
+            snprintf(name, sizeof(name), "validate.ulp_le_%g", ULP_BOUNDS[i]);
+        else
+            snprintf(name, sizeof(name), "validate.ulp_gt_%g", ULP_BOUNDS[i - 1]);
+        report.add_metric(name, double(ulp_hist[i]));
+    }
+    for (int i = 0; i < NUM_REL_BUCKET; i++)
+    {
+        if (i < NUM_REL_BUCKET - 1)
+            snprintf(name, sizeof(name), "validate.rel_le_%g", REL_BOUNDS[i]);
+        else
+            snprintf(name, sizeof(name), "validate.rel_gt_%g", REL_BOUNDS[i - 1]);
+        report.add_metric(name, double(rel_hist[i]));
+    }
+}
+
+// splitmix64, each sample index is derived from its own counter so tasks need no shared state
+static inline uint64_t mix_index(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+template<typename T>
+static void validate_typed(const Expr& formula, const float* in, const float* result, size_t n,
+                           HostThreadPool* pool, size_t num_check, uint64_t seed, ErrorStats& stats)
+{
+    typedef StorageTraits<T> Traits;
+    bool sampled = num_check && num_check < n;
+    size_t num_task = sampled ? num_check : n;
+    std::mutex lock;
+
+    HostThreadPool::RangeFunc task = [&](size_t begin, size_t end) {
+        size_t len = end - begin;
+        std::vector<size_t> index(len);
+        std::vector<float> in_sub(len);
+        std::vector<float> expect(len);
+        ErrorStats local;
+
+        // the reference sees the inputs as the device saw them
+        for (size_t i = 0; i < len; i++)
+        {
+            index[i] = sampled ? size_t(mix_index(seed * 0x100000001b3ULL + begin + i) % n) : begin + i;
+            in_sub[i] = Traits::round(in[index[i]]);
+        }
+        formula.eval_ref(&in_sub[0], &expect[0], len);
+        for (size_t i = 0; i < len; i++)
+            local.add(int64_t(index[i]), result[index[i]], expect[i], Traits::storage());
+
+        std::lock_guard<std::mutex> guard(lock);
+        stats.merge(local);
+    };
+
+    if (pool)
+        pool->parallel_for(num_task, VALIDATE_CHUNK, task);
+    else
+        for (size_t begin = 0; begin < num_task; begin += VALIDATE_CHUNK)
+            task(begin, std::min(num_task, begin + VALIDATE_CHUNK));
+}
+
+void validate_results(const Expr& formula, const float* in, const float* result, size_t n,
+                      HostThreadPool* pool, size_t num_check, uint64_t seed, ErrorStats& stats,
+                      StorageType storage)
+{
+    switch (storage)
+    {
+    case STORAGE_FP32: validate_typed<cl_float>(formula, in, result, n, pool, num_check, seed, stats); break;
+    case STORAGE_FP16: validate_typed<cl_half>(formula, in, result, n, pool, num_check, seed, stats); break;
+    case STORAGE_FP64: validate_typed<cl_double>(formula, in, result, n, pool, num_check, seed, stats); break;
+    default: abort();
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef MY_VALIDATOR_H
+#define MY_VALIDATOR_H
+
+#include <cstddef>
+#include <stdint.h>
+
+#include "bench_report.h"
+#include "utils.h"
+
+class Expr;
+class HostThreadPool;
+
+///
+/// \brief error of calculated results against the reference
+///
+/// ULP distance counts the representable floats between result and reference,
+/// so it is exact for any magnitude, including denormals and signed zeros.
+/// Results that are NaN where the reference is not, or the other way round,
+/// are counted as NaN mismatches and left out of the error sums. Results of
+/// fp16 storage are counted in half ULPs instead, and fp64 results, narrowed
+/// into the float host arrays, in float ULPs.
+///
+struct ErrorStats
+{
+    // upper bounds of the ULP buckets, the last bucket takes everything above
+    static const int NUM_ULP_BUCKET = 7;
+    static const double ULP_BOUNDS[NUM_ULP_BUCKET - 1];
+
+    // upper bounds of the relative error buckets
+    static const int NUM_REL_BUCKET = 6;
+    static const double REL_BOUNDS[NUM_REL_BUCKET - 1];
+
+    size_t count = 0;
+    size_t nan_mismatch = 0;
+    double max_ulp = 0.0;
+    double sum_ulp = 0.0;
+    double max_rel = 0.0;
+    double sum_rel = 0.0;
+    int64_t worst_index = -1; // sample with max_ulp
+    size_t ulp_hist[NUM_ULP_BUCKET] = {};
+    size_t rel_hist[NUM_REL_BUCKET] = {};
+
+    void add(int64_t index, float result, float expect, StorageType storage = STORAGE_FP32);
+    void merge(const ErrorStats& other);
+    void clear() { *this = ErrorStats(); }
+
+    ///
+    /// \brief add metrics "validate.checked", "validate.max_ulp", "validate.mean_ulp",
+    /// "validate.max_rel", "validate.mean_rel", the histograms and the NaN mismatches
+    ///
+    void add_to_report(BenchReport& report) const;
+};
+
+///
+/// \brief compare result[i] with formula.eval_ref(in[i]) for i in [0, n)
+///
+/// Reference values are calculated blockwise, and blocks are spread over the
+/// pool's threads when pool is not null.
+///
+/// The reference is calculated from inputs as the storage type keeps them. With
+/// fp16 storage the device only saw inputs rounded to half and could only
+/// store results rounded to half, so the error is counted in half ULPs: a
+/// correct kernel stays within a few of them while it is thousands of float
+/// ULPs off.
+///
+/// \param num_check check this many random samples instead of all, 0 for all
+/// \param seed      selects the random samples
+///
+void validate_results(const Expr& formula, const float* in, const float* result, size_t n,
+                      HostThreadPool* pool, size_t num_check, uint64_t seed, ErrorStats& stats,
+                      StorageType storage = STORAGE_FP32);
+
+#endif // MY_VALIDATOR_H